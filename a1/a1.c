@@ -3,14 +3,75 @@
 #include <string.h>
 #include <ctype.h>
 
+// The default dictionary is preprocessed into the binary by 'make embed'
+#ifdef EMBED_DICT
+#include "dict.h"
+#endif
+
+// Size of the buffers used to store each dictionary word
+#define WORD_SIZE 50
+
+// Number of letters in the alphabet
+#define ALPHABET 26
+
+// Number of bits in each block of a pattern index bitmap
+#define BLOCK_BITS (8 * (int)sizeof(unsigned long))
+
 // Creates a parameters struct to store the info of input parameters
 struct Parameters {
     int alpha;
     int len;
     int longest;
+    int exact;
+    int session;
     char include;
     char* letters;
+    char* pattern;
     char* filename;
+    int dictGiven;
+};
+
+// Creates a pattern index struct used to answer '-pattern' queries
+// Words are grouped by length, 'ids[len]' stores the dictionary index of
+// every word of that length and 'bitmaps[len]' stores one bitmap for each
+// (position, letter) pair, with a bit set for each word that has that letter
+// at that position
+// The index is generated by dictgen and only exists in the embedded build
+struct PatternIndex {
+    int counts[WORD_SIZE];
+    int blocks[WORD_SIZE];
+    int* ids[WORD_SIZE];
+    unsigned long* bitmaps[WORD_SIZE];
+};
+
+// Creates a session struct which keeps the result of the previous query in
+// '-session' mode so that each new query only updates the affected words.
+// 'deficits[i]' is the number of letters word i needs that are not in the
+// pool, and 'candidates' has a bit set for every word with a deficit of 0.
+// 'letterIds[letter]' lists the words containing that letter, sorted by how
+// many times it appears, with the first 'atLeast[letter][k]' of them being
+// the words which contain that letter at least k times.
+// 'patternMask' has a bit set for every word matching the '-pattern' arg, 
+// found once for the whole session (NULL if no pattern was given).
+struct Session {
+    int histogram[ALPHABET];
+    int wordTotal;
+    unsigned char* deficits;
+    unsigned long* candidates;
+    unsigned long* patternMask;
+    int* letterIds[ALPHABET];
+    int atLeast[ALPHABET][WORD_SIZE + 1];
+};
+
+// Creates an anagram table struct used to answer '-exact' queries
+// Words are hashed by their key (their letters in sorted order) into 'size'
+// buckets, a power of 2, and the dictionary indices of the words in bucket b
+// are 'ids[starts[b]]' up to 'ids[starts[b + 1]]', in dictionary order
+// The table is generated by dictgen in the embedded build
+struct AnagramTable {
+    int size;
+    int* starts;
+    int* ids;
 };
 
 // Function prototypes
@@ -22,6 +83,8 @@ int check_include_error(struct Parameters par);
 int check_invalid(int argc, char** argv, int*, int*, int*, int);
 int check_invalid_command(int argc, char** argv);
 int check_invalid_dict(char*);
+int check_embedded_dict(int);
+int check_pattern_arg(char*);
 int check_letters_arg(int argc, char** argv);
 int check_alphabetic_chars(int argc, char** argv);
 struct Parameters handle_args(int argc, char** argv, struct Parameters par);
@@ -30,10 +93,33 @@ char** open_dict_file(char*, char**, int*);
 char** copy_file_words(char**, char**, int);
 void to_lower_case(char**, int);
 void letters_alpha_order(char*);
-int* compare_words(char**, char*, int*, int, int*, char);
+int* compare_words(char**, char*, char*, int*, int, int*, char);
 int compare_characters(char*, char*, char);
 int is_not_alpha(char);
 int check_include(char, char);
+int word_length(char*);
+struct PatternIndex embedded_pattern_index(void);
+unsigned long* pattern_bitmap(struct PatternIndex*, int, int, int);
+unsigned long* pattern_matches(struct PatternIndex*, char*);
+int* compare_pattern(struct PatternIndex*, char**, char*, char*, int*, 
+        int*, char);
+unsigned long* session_pattern_mask(char**, int, char*, int);
+int match_pattern(char*, char*);
+void anagram_key(char*, char*);
+unsigned int hash_key(char*);
+struct AnagramTable build_anagram_table(char**, int);
+struct AnagramTable embedded_anagram_table(void);
+int* compare_exact(struct AnagramTable*, char**, char*, char*, int*, int*, 
+        char);
+int* scan_exact(char**, char*, char*, int*, int, int*, char);
+void free_anagram_table(struct AnagramTable*);
+struct Session init_session(char**, int, char*, int);
+void add_session_letter(struct Session*, int);
+void remove_session_letter(struct Session*, int);
+void set_session_letters(struct Session*, char*);
+int* compare_session(struct Session*, char**, struct Parameters, int*, int*);
+void run_session(struct Parameters, char**, char**, int, int);
+void free_session(struct Session*);
 void get_matching_words(char**, char**, int*, int);
 void sort_words(char**, int, int);
 void sort_ascii(char**, int);
@@ -61,24 +147,58 @@ int main(int argc, char** argv) {
     par = handle_args(argc, argv, par); 
     handle_letters_arg(par.letters, &par.include);
 
-    if (check_invalid_dict(par.filename)) {
+    int embedded = check_embedded_dict(par.dictGiven);
+    if (!embedded && check_invalid_dict(par.filename)) {
         fprintf(stderr, "unjumble: file \"%s\" can not be opened\n", 
                 par.filename);
         return 2;
     }
 
     // Creates all arrays and counters nessecary to keep track of the words
-    char** fileWords = (char**)malloc(0);
+    char** fileWords;
+    char** fileWordsCopy;
     int lineCount = 1, wordCount = 0, longestCount = 0;
-    fileWords = open_dict_file(par.filename, fileWords, &lineCount);
 
-    char** fileWordsCopy = (char**)malloc(0);
-    fileWordsCopy = copy_file_words(fileWords, fileWordsCopy, lineCount);
-    to_lower_case(fileWordsCopy, lineCount);
+    // The embedded dictionary is already filtered and in lower case,
+    // so it is used directly without reading or copying any words
+    if (embedded) {
+#ifdef EMBED_DICT
+        fileWords = (char**)embeddedWords;
+        fileWordsCopy = (char**)embeddedWordsLower;
+        lineCount = EMBEDDED_COUNT + 1;
+#endif
+    } else {
+        fileWords = (char**)malloc(0);
+        fileWords = open_dict_file(par.filename, fileWords, &lineCount);
 
+        fileWordsCopy = (char**)malloc(0);
+        fileWordsCopy = copy_file_words(fileWords, fileWordsCopy, lineCount);
+        to_lower_case(fileWordsCopy, lineCount);
+    }
+
+    // Session mode answers queries from stdin until it is closed
+    // With the embedded dictionary, exact queries are answered from its 
+    // anagram table and pattern queries from its per-position letter index
+    // Otherwise a table would take longer to build than one query takes, so
+    // every word is compared against the letters arg and the pattern
     int* indices = (int*)malloc(0);
-    indices = compare_words(fileWordsCopy, par.letters, indices, 
-            lineCount, &wordCount, par.include);
+    if (par.session) {
+        run_session(par, fileWords, fileWordsCopy, lineCount, embedded);
+    } else if (par.exact && embedded) {
+        struct AnagramTable table = embedded_anagram_table();
+        indices = compare_exact(&table, fileWordsCopy, par.letters, 
+                par.pattern, indices, &wordCount, par.include);
+    } else if (par.exact) {
+        indices = scan_exact(fileWordsCopy, par.letters, par.pattern, 
+                indices, lineCount, &wordCount, par.include);
+    } else if (par.pattern != NULL && embedded) {
+        struct PatternIndex index = embedded_pattern_index();
+        indices = compare_pattern(&index, fileWordsCopy, par.letters, 
+                par.pattern, indices, &wordCount, par.include);
+    } else {
+        indices = compare_words(fileWordsCopy, par.letters, par.pattern, 
+                indices, lineCount, &wordCount, par.include);
+    }
 
     char** matchingWords = (char**)malloc(wordCount * sizeof(char*));
     get_matching_words(fileWords, matchingWords, indices, wordCount);
@@ -90,15 +210,18 @@ int main(int argc, char** argv) {
 
     // Frees all allocated memory
     free(par.letters);
+    free(par.pattern);
     free(par.filename);
     free(indices);
     free_alloc_mem(longestWords, longestCount);
     free_alloc_mem(matchingWords, wordCount);
-    free_alloc_mem(fileWordsCopy, lineCount - 1);
-    free_alloc_mem(fileWords, lineCount - 1);
+    if (!embedded) {
+        free_alloc_mem(fileWordsCopy, lineCount - 1);
+        free_alloc_mem(fileWords, lineCount - 1);
+    }
 
     // Returns 10 if no matching words are found
-    if (wordCount == 0) {
+    if (wordCount == 0 && !par.session) {
         return 10;
     }
     return 0;
@@ -134,7 +257,8 @@ int check_arg_errors(int argc, char** argv) {
 
     // Error messages
     char invalidCommand[] = "Usage: unjumble [-alpha|-len|-longest] "
-            "[-include letter] letters [dictionary]\n";
+            "[-include letter] [-pattern pattern] [-exact] [-session] "
+            "letters [dictionary]\n";
     char invalidLettersArg[] = "unjumble: "
             "must supply at least three letters\n";
     char nonAlphaChar[] = "unjumble: "
@@ -157,16 +281,23 @@ int check_arg_errors(int argc, char** argv) {
 // Initialises variables in the parameters struct
 struct Parameters init_parameters(struct Parameters par, char* defaultDict) {
 
-    // 'alpha', 'len' and 'longest' are assigned 0 by default.
+    // 'alpha', 'len', 'longest', 'exact' and 'session' are assigned 0 by 
+    // default.
     par.alpha = 0;
     par.len = 0;
     par.longest = 0;
+    par.exact = 0;
+    par.session = 0;
     
     // 'include' is assigned null by default
     par.include = '\0';
+
+    // 'pattern' is assigned NULL unless '-pattern' is specified
+    par.pattern = NULL;
     
     // 'letters' and 'filename' are initialised
-    // 'filename' stored the default file directory
+    // 'filename' stored the default file directory until 'dictGiven' is set
+    par.dictGiven = 0;
     par.letters = (char*)malloc(0);
     int filenameLen = strlen(defaultDict) + 2;
     par.filename = (char*)malloc(filenameLen * sizeof(char));
@@ -191,7 +322,10 @@ int check_invalid(int argc, char** argv, int* argCount, int* letterCount,
             if (strcmp(argv[i + 1], "-alpha") == 0 ||
                     strcmp(argv[i + 1], "-len") == 0 ||
                     strcmp(argv[i + 1], "-longest") == 0 ||
-                    strcmp(argv[i + 1], "-include") == 0) {
+                    strcmp(argv[i + 1], "-include") == 0 ||
+                    strcmp(argv[i + 1], "-pattern") == 0 ||
+                    strcmp(argv[i + 1], "-exact") == 0 ||
+                    strcmp(argv[i + 1], "-session") == 0) {
                 check = 0; 
 
             // Returns 1 if the arg behind '-' is invalid
@@ -200,7 +334,8 @@ int check_invalid(int argc, char** argv, int* argCount, int* letterCount,
             }
 
         } else {
-            if (strcmp(argv[i], "-include") == 0) {
+            if (strcmp(argv[i], "-include") == 0 || 
+                    strcmp(argv[i], "-pattern") == 0) {
                 ;
             } else if ((*letterCount > 0)) {
                 (*dictCount)++;
@@ -214,8 +349,8 @@ int check_invalid(int argc, char** argv, int* argCount, int* letterCount,
             }
         }
 
-        // Returns 1 if > 2 '-' arg is given
-        if ((*argCount) > 2) {
+        // Returns 1 if > 5 '-' arg is given
+        if ((*argCount) > 5) {
             return 1;
         }
     }
@@ -227,7 +362,7 @@ int check_invalid_command(int argc, char** argv) {
     int check = 0;
 
     // Returns 1 if the number of args is invalid
-    if (argc < 2 || argc > 6) {
+    if (argc < 2 || argc > 10) {
         return 1; 
     }
 
@@ -240,9 +375,24 @@ int check_invalid_command(int argc, char** argv) {
         return 1; 
     }
     
-    int includeArg = 0;
+    int includeArg = 0, patternArg = 0, exactArg = 0, sessionArg = 0;
     for (int j = 0; j < argc - 1; j++) {
 
+        if (strcmp(argv[j + 1], "-exact") == 0) {
+            exactArg++;
+        } else if (strcmp(argv[j + 1], "-session") == 0) {
+            sessionArg++;
+        }
+
+        if (strcmp(argv[j + 1], "-pattern") == 0) {
+            patternArg++;
+
+            // Returns 1 if '-pattern' is not followed by letters and '?'s
+            if (argv[j + 2] == NULL || check_pattern_arg(argv[j + 2])) {
+                return 1;
+            }
+        }
+
         if (strcmp(argv[j + 1], "-include") == 0) {
             includeArg = 1;
 
@@ -260,8 +410,8 @@ int check_invalid_command(int argc, char** argv) {
     }
 
     // Returns 1 if more than 1 parameter arg is given
-    if ((argCount > 1 && includeArg == 0) || 
-            (argCount > 2 && includeArg == 1)) {
+    if (argCount > 1 + includeArg + patternArg + exactArg + sessionArg || 
+            patternArg > 1 || exactArg > 1 || sessionArg > 1) {
         return 1; 
     }
     return check;
@@ -280,13 +430,44 @@ int check_invalid_dict(char* filename) {
     return 0;
 }
 
+// Checks that the '-pattern' arg only contains letters and '?' wildcards
+int check_pattern_arg(char* pattern) {
+
+    // Returns 1 if the pattern is empty or too long to match any word
+    int len = strlen(pattern);
+    if (len == 0 || len >= WORD_SIZE - 1) {
+        return 1;
+    }
+
+    // Returns 1 if the pattern contains any other character
+    for (int i = 0; i < len; i++) {
+        if (is_not_alpha(pattern[i]) && pattern[i] != '?') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Checks if the embedded dictionary should be used instead of the file
+// Returns 1 only if unjumble was built with 'make embed' and no dictionary
+// was given in the arguments, even one naming the default dictionary, as 
+// that file may have changed since it was embedded
+int check_embedded_dict(int dictGiven) {
+#ifdef EMBED_DICT
+    return !dictGiven;
+#else
+    return 0;
+#endif
+}
+
 // Checks if the letters argument contains less than 3 letters
 int check_letters_arg(int argc, char** argv) {
     int argInclude = 0;
 
     for (int i = 0; i < argc - 1; i++) {
 
-        if (argv[i + 1][0] != '-' && strcmp(argv[i], "-include") == 0) {
+        if (argv[i + 1][0] != '-' && (strcmp(argv[i], "-include") == 0 ||
+                strcmp(argv[i], "-pattern") == 0)) {
             argInclude = 1;
         }
 
@@ -305,6 +486,11 @@ int check_alphabetic_chars(int argc, char** argv) {
 
     for (int i = 0; i < argc - 1; i++) {
 
+        // The '-pattern' arg is checked by 'check_pattern_arg' instead
+        if (strcmp(argv[i], "-pattern") == 0) {
+            continue;
+        }
+
         if (strcmp(argv[i + 1], "-include") == 0) {
             argInclude = 1;
         } else if ((argInclude = 0 && argCount == 1) ||
@@ -352,6 +538,10 @@ struct Parameters handle_args(int argc, char** argv, struct Parameters par) {
                 par.len = 1;
             } else if (strcmp(argv[i + 1], "-longest") == 0) {
                 par.longest = 1;
+            } else if (strcmp(argv[i + 1], "-exact") == 0) {
+                par.exact = 1;
+            } else if (strcmp(argv[i + 1], "-session") == 0) {
+                par.session = 1;
             }
 
             // Assignes the specified character to 'include' if the 
@@ -360,14 +550,26 @@ struct Parameters handle_args(int argc, char** argv, struct Parameters par) {
                 par.include = argv[i + 2][0];
             }
 
+            // Copies the specified pattern to 'pattern' in lower case if 
+            // the '-pattern' arg was specified by user
+            if (strcmp(argv[i + 1], "-pattern") == 0) {
+                int len = strlen(argv[i + 2]) + 1;
+                par.pattern = (char*)malloc(len * sizeof(char));
+                for (int j = 0; j < len; j++) {
+                    par.pattern[j] = (char)tolower((int)argv[i + 2][j]);
+                }
+            }
+
         // Assigns the letters arg and the specified file name/directory to 
         // 'letters' and 'filename' respectively
-        } else if (strcmp(argv[i], "-include") == 0) {
+        } else if (strcmp(argv[i], "-include") == 0 || 
+                strcmp(argv[i], "-pattern") == 0) {
             ;
         } else if (lettersCount > 0) {
             int len = strlen(argv[i + 1]) + 2;
             par.filename = (char*)realloc(par.filename, len * sizeof(char));
             strcpy(par.filename, argv[i + 1]);
+            par.dictGiven = 1;
         } else {
             int len = strlen(argv[i + 1]) + 2;
             par.letters = (char*)realloc(par.letters, len * sizeof(char));
@@ -459,13 +661,15 @@ void to_lower_case(char** fileWords, int lineCount) {
 }
 
 // Compares the words from the dict file to the letters arg
-int* compare_words(char** fileWords, char* letters, int* indices, 
-        int lineCount, int* wordCount, char include) {
+// Words not matching the pattern are skipped if a pattern was specified
+int* compare_words(char** fileWords, char* letters, char* pattern, 
+        int* indices, int lineCount, int* wordCount, char include) {
     for (int i = 0; i < lineCount - 1; i++) {
 
         // Calls the 'compare_characters' func and keeps track of matches 
         // The 'compare_characters' func is where the chars are compared
-        if (compare_characters(fileWords[i], letters, include)) {
+        if (match_pattern(fileWords[i], pattern) && 
+                compare_characters(fileWords[i], letters, include)) {
             (*wordCount)++;
 
             indices = (int*)realloc(indices, (*wordCount) * sizeof(int));
@@ -544,6 +748,548 @@ int check_include(char letter, char include) {
     return 0;
 }
 
+// Gets the number of characters in a dictionary word, excluding the newline
+int word_length(char* word) {
+    int len = 0;
+    while (word[len] != '\n' && word[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+// Gets the per-position letter index generated by dictgen for the embedded
+// dictionary, the arrays of each length are found from the word counts
+// The index is empty if unjumble was not built with 'make embed'
+struct PatternIndex embedded_pattern_index(void) {
+    struct PatternIndex index;
+    memset(&index, 0, sizeof(index));
+
+#ifdef EMBED_DICT
+    int idStart = 0, bitmapStart = 0;
+    for (int len = 0; len < WORD_SIZE; len++) {
+        index.counts[len] = embeddedPatternCounts[len];
+        index.blocks[len] = (index.counts[len] + BLOCK_BITS - 1) / BLOCK_BITS;
+        index.ids[len] = (int*)embeddedPatternIds + idStart;
+        index.bitmaps[len] = (unsigned long*)embeddedPatternBitmaps + 
+                bitmapStart;
+        idStart += index.counts[len];
+        bitmapStart += len * ALPHABET * index.blocks[len];
+    }
+#endif
+    return index;
+}
+
+// Gets the bitmap of words of length 'len' with 'letter' at position 'pos'
+unsigned long* pattern_bitmap(struct PatternIndex* index, int len, int pos, 
+        int letter) {
+    return index->bitmaps[len] + 
+            (pos * ALPHABET + (letter - 'a')) * index->blocks[len];
+}
+
+// Intersects the bitmaps for each fixed letter in the pattern
+// Returns a bitmap over the words of the pattern's length, with a bit set 
+// for each word that matches the pattern
+unsigned long* pattern_matches(struct PatternIndex* index, char* pattern) {
+    int len = strlen(pattern);
+    int blocks = index->blocks[len];
+    unsigned long* matches = (unsigned long*)malloc(
+            blocks * sizeof(unsigned long));
+
+    // Every word of the pattern's length matches until a letter is fixed
+    memset(matches, 0xff, blocks * sizeof(unsigned long));
+    for (int pos = 0; pos < len; pos++) {
+        if (pattern[pos] != '?') {
+            unsigned long* bitmap = pattern_bitmap(index, len, pos, 
+                    pattern[pos]);
+            for (int b = 0; b < blocks; b++) {
+                matches[b] &= bitmap[b];
+            }
+        }
+    }
+    return matches;
+}
+
+// Finds the words which match the pattern and can be made from the letters
+// Only the words left by intersecting the pattern's bitmaps are compared 
+// against the letters arg
+int* compare_pattern(struct PatternIndex* index, char** fileWords, 
+        char* letters, char* pattern, int* indices, int* wordCount, 
+        char include) {
+
+    int len = strlen(pattern);
+    int blocks = index->blocks[len];
+    unsigned long* matches = pattern_matches(index, pattern);
+
+    // Compares the chars of each remaining word with the letters arg
+    indices = (int*)realloc(indices, index->counts[len] * sizeof(int));
+    for (int b = 0; b < blocks; b++) {
+        unsigned long bits = matches[b];
+
+        while (bits) {
+            int id = b * BLOCK_BITS + __builtin_ctzl(bits);
+            bits &= bits - 1;
+
+            if (id >= index->counts[len]) {
+                break;
+            }
+
+            int i = index->ids[len][id];
+            if (compare_characters(fileWords[i], letters, include)) {
+                indices[(*wordCount)++] = i;
+            }
+        }
+    }
+    free(matches);
+    return indices;
+}
+
+// Finds every word matching the pattern once for a whole '-session'
+// The embedded pattern index is used if there is one, else each word is 
+// checked against the pattern
+// Returns a bitmap over all the words with a bit set for each match
+unsigned long* session_pattern_mask(char** fileWords, int lineCount, 
+        char* pattern, int embedded) {
+
+    int blocks = (lineCount - 1 + BLOCK_BITS - 1) / BLOCK_BITS;
+    unsigned long* mask = (unsigned long*)calloc(blocks, 
+            sizeof(unsigned long));
+
+    if (!embedded) {
+        for (int i = 0; i < lineCount - 1; i++) {
+            if (match_pattern(fileWords[i], pattern)) {
+                mask[i / BLOCK_BITS] |= 1UL << (i % BLOCK_BITS);
+            }
+        }
+        return mask;
+    }
+
+    struct PatternIndex index = embedded_pattern_index();
+    int len = strlen(pattern);
+    unsigned long* matches = pattern_matches(&index, pattern);
+
+    // Each bit of the index is for the id'th word of the pattern's length
+    for (int b = 0; b < index.blocks[len]; b++) {
+        unsigned long bits = matches[b];
+
+        while (bits) {
+            int id = b * BLOCK_BITS + __builtin_ctzl(bits);
+            bits &= bits - 1;
+
+            if (id < index.counts[len]) {
+                int i = index.ids[len][id];
+                mask[i / BLOCK_BITS] |= 1UL << (i % BLOCK_BITS);
+            }
+        }
+    }
+    free(matches);
+    return mask;
+}
+
+// Checks that a word has the same length and fixed letters as a pattern
+// Returns 1 if the word matches or if no pattern was specified
+int match_pattern(char* word, char* pattern) {
+
+    if (pattern == NULL) {
+        return 1;
+    } else if (word_length(word) != (int)strlen(pattern)) {
+        return 0;
+    }
+
+    for (int i = 0; pattern[i] != '\0'; i++) {
+        if (pattern[i] != '?' && pattern[i] != word[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Writes the anagram key of a lower case word (its letters in sorted order)
+// Only alphabetic characters are included in the key
+void anagram_key(char* word, char* key) {
+    int letterCounts[ALPHABET] = {0};
+
+    for (int i = 0; word[i] != '\0'; i++) {
+        if (!is_not_alpha(word[i])) {
+            letterCounts[word[i] - 'a']++;
+        }
+    }
+
+    int len = 0;
+    for (int i = 0; i < ALPHABET; i++) {
+        for (int j = 0; j < letterCounts[i] && len < WORD_SIZE - 1; j++) {
+            key[len++] = (char)('a' + i);
+        }
+    }
+    key[len] = '\0';
+}
+
+// Gets the FNV-1a hash of an anagram key
+unsigned int hash_key(char* key) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; key[i] != '\0'; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Builds the anagram table over the lower case dictionary words
+// The words are placed in their buckets with a counting sort, filling each 
+// bucket from the end so its words stay in dictionary order
+struct AnagramTable build_anagram_table(char** fileWords, int lineCount) {
+    struct AnagramTable table;
+    char key[WORD_SIZE];
+    int wordTotal = lineCount - 1;
+
+    // Uses at least twice as many buckets as words to keep buckets small
+    table.size = 1;
+    while (table.size < 2 * wordTotal) {
+        table.size *= 2;
+    }
+    table.starts = (int*)calloc(table.size + 1, sizeof(int));
+    table.ids = (int*)malloc(wordTotal * sizeof(int));
+    unsigned int* buckets = (unsigned int*)malloc(wordTotal * 
+            sizeof(unsigned int));
+
+    // First counts the words in each bucket, then finds where each ends
+    for (int i = 0; i < wordTotal; i++) {
+        anagram_key(fileWords[i], key);
+        buckets[i] = hash_key(key) & (table.size - 1);
+        table.starts[buckets[i]]++;
+    }
+    for (int b = 1; b <= table.size; b++) {
+        table.starts[b] += table.starts[b - 1];
+    }
+
+    // Each bucket's end moves back to its start as its words are placed
+    for (int i = wordTotal - 1; i >= 0; i--) {
+        table.ids[--table.starts[buckets[i]]] = i;
+    }
+    free(buckets);
+    return table;
+}
+
+// Gets the anagram table generated by dictgen for the embedded dictionary
+// The table is empty if unjumble was not built with 'make embed'
+struct AnagramTable embedded_anagram_table(void) {
+    struct AnagramTable table;
+
+#ifdef EMBED_DICT
+    table.size = EMBEDDED_ANAGRAM_SIZE;
+    table.starts = (int*)embeddedAnagramStarts;
+    table.ids = (int*)embeddedAnagramIds;
+#else
+    static int emptyStarts[2] = {0, 0};
+    table.size = 1;
+    table.starts = emptyStarts;
+    table.ids = NULL;
+#endif
+    return table;
+}
+
+// Finds the words which use every letter of the letters arg exactly once
+// Only the bucket for the letters' anagram key is looked at, each of its 
+// words with that key is then checked against the '-pattern' arg
+int* compare_exact(struct AnagramTable* table, char** fileWords, 
+        char* letters, char* pattern, int* indices, int* wordCount, 
+        char include) {
+
+    char key[WORD_SIZE], wordKey[WORD_SIZE];
+    anagram_key(letters, key);
+    unsigned int bucket = hash_key(key) & (table->size - 1);
+    int first = table->starts[bucket], last = table->starts[bucket + 1];
+
+    // Returns no matches if the include letter is not one of the letters
+    if (first == last || (include != '\0' && strchr(key, include) == NULL)) {
+        return indices;
+    }
+
+    indices = (int*)realloc(indices, (last - first) * sizeof(int));
+    for (int j = first; j < last; j++) {
+        int i = table->ids[j];
+
+        anagram_key(fileWords[i], wordKey);
+        if (strcmp(wordKey, key) == 0 && match_pattern(fileWords[i], 
+                pattern)) {
+            indices[(*wordCount)++] = i;
+        }
+    }
+    return indices;
+}
+
+// Finds the words which use every letter of the letters arg exactly once
+// by comparing the anagram key of each word of the same length, which is
+// used for one query on a dictionary file instead of building a table
+int* scan_exact(char** fileWords, char* letters, char* pattern, 
+        int* indices, int lineCount, int* wordCount, char include) {
+
+    char key[WORD_SIZE], wordKey[WORD_SIZE];
+    anagram_key(letters, key);
+    int len = word_length(letters);
+
+    // Returns no matches if the include letter is not one of the letters
+    if (include != '\0' && strchr(key, include) == NULL) {
+        return indices;
+    }
+
+    for (int i = 0; i < lineCount - 1; i++) {
+        if (word_length(fileWords[i]) != len || 
+                !match_pattern(fileWords[i], pattern)) {
+            continue;
+        }
+
+        anagram_key(fileWords[i], wordKey);
+        if (strcmp(wordKey, key) == 0) {
+            (*wordCount)++;
+            indices = (int*)realloc(indices, (*wordCount) * sizeof(int));
+            indices[(*wordCount) - 1] = i;
+        }
+    }
+    return indices;
+}
+
+// Frees the memory allocated for the anagram table
+void free_anagram_table(struct AnagramTable* table) {
+    free(table->starts);
+    free(table->ids);
+}
+
+// Initialises the session state for an empty pool of letters
+// Every word starts with a deficit equal to its length, and the words
+// containing each letter are sorted by that letter's count using a counting
+// sort so that 'atLeast' can give the words affected by each update
+// The words matching the pattern are found here if one was given
+struct Session init_session(char** fileWords, int lineCount, char* pattern, 
+        int embedded) {
+    struct Session session;
+    memset(&session, 0, sizeof(session));
+
+    if (pattern != NULL) {
+        session.patternMask = session_pattern_mask(fileWords, lineCount, 
+                pattern, embedded);
+    }
+
+    session.wordTotal = lineCount - 1;
+    int blocks = (session.wordTotal + BLOCK_BITS - 1) / BLOCK_BITS;
+    session.deficits = (unsigned char*)malloc(session.wordTotal);
+    session.candidates = (unsigned long*)calloc(blocks, 
+            sizeof(unsigned long));
+
+    // First counts the words with each number of each letter
+    for (int i = 0; i < session.wordTotal; i++) {
+        int letterCounts[ALPHABET] = {0};
+        session.deficits[i] = (unsigned char)str_length(fileWords[i]);
+
+        for (int j = 0; fileWords[i][j] != '\n'; j++) {
+            letterCounts[fileWords[i][j] - 'a']++;
+        }
+        for (int c = 0; c < ALPHABET; c++) {
+            session.atLeast[c][letterCounts[c]]++;
+        }
+    }
+
+    // Then turns the counts into the number of words with at least k of 
+    // each letter, which are also the offsets used by the counting sort
+    int offsets[ALPHABET][WORD_SIZE + 1];
+    for (int c = 0; c < ALPHABET; c++) {
+        for (int k = WORD_SIZE - 1; k >= 1; k--) {
+            session.atLeast[c][k] += session.atLeast[c][k + 1];
+        }
+        for (int k = 1; k < WORD_SIZE; k++) {
+            offsets[c][k] = session.atLeast[c][k + 1];
+        }
+        session.atLeast[c][0] = session.atLeast[c][1];
+        session.letterIds[c] = (int*)malloc(session.atLeast[c][1] * 
+                sizeof(int));
+    }
+
+    // Finally places each word after the words with more of each letter
+    for (int i = 0; i < session.wordTotal; i++) {
+        int letterCounts[ALPHABET] = {0};
+
+        for (int j = 0; fileWords[i][j] != '\n'; j++) {
+            letterCounts[fileWords[i][j] - 'a']++;
+        }
+        for (int c = 0; c < ALPHABET; c++) {
+            if (letterCounts[c] > 0) {
+                int k = letterCounts[c];
+                session.letterIds[c][offsets[c][k]++] = i;
+            }
+        }
+    }
+    return session;
+}
+
+// Adds a letter to the session's pool
+// Only the words which have more of that letter than the pool had are
+// missing one less letter, any that are no longer missing letters match
+void add_session_letter(struct Session* session, int letter) {
+    int count = session->histogram[letter] + 1;
+    int affected = count < WORD_SIZE ? session->atLeast[letter][count] : 0;
+
+    for (int i = 0; i < affected; i++) {
+        int id = session->letterIds[letter][i];
+
+        if (--(session->deficits[id]) == 0) {
+            session->candidates[id / BLOCK_BITS] |= 1UL << (id % BLOCK_BITS);
+        }
+    }
+    session->histogram[letter]++;
+}
+
+// Removes a letter from the session's pool
+// Only the words which have at least as many of that letter as the pool had
+// are missing one more letter, any that matched before no longer match
+void remove_session_letter(struct Session* session, int letter) {
+    int count = session->histogram[letter];
+    int affected = count < WORD_SIZE ? session->atLeast[letter][count] : 0;
+
+    for (int i = 0; i < affected; i++) {
+        int id = session->letterIds[letter][i];
+
+        if ((session->deficits[id])++ == 0) {
+            session->candidates[id / BLOCK_BITS] &= 
+                    ~(1UL << (id % BLOCK_BITS));
+        }
+    }
+    session->histogram[letter]--;
+}
+
+// Updates the session's pool to the given lower case letters
+// Only the difference between the previous and the new letters is applied
+void set_session_letters(struct Session* session, char* letters) {
+    int histogram[ALPHABET] = {0};
+
+    for (int i = 0; letters[i] != '\0'; i++) {
+        if (!is_not_alpha(letters[i])) {
+            histogram[letters[i] - 'a']++;
+        }
+    }
+
+    for (int c = 0; c < ALPHABET; c++) {
+        while (session->histogram[c] > histogram[c]) {
+            remove_session_letter(session, c);
+        }
+        while (session->histogram[c] < histogram[c]) {
+            add_session_letter(session, c);
+        }
+    }
+}
+
+// Gets the current session matches which also satisfy the '-include' and 
+// '-pattern' args
+// Words not matching the pattern are masked off a whole block at a time
+int* compare_session(struct Session* session, char** fileWords, 
+        struct Parameters par, int* indices, int* wordCount) {
+
+    int blocks = (session->wordTotal + BLOCK_BITS - 1) / BLOCK_BITS;
+    int capacity = 0;
+
+    for (int b = 0; b < blocks; b++) {
+        unsigned long bits = session->candidates[b];
+        if (session->patternMask != NULL) {
+            bits &= session->patternMask[b];
+        }
+
+        while (bits) {
+            int i = b * BLOCK_BITS + __builtin_ctzl(bits);
+            bits &= bits - 1;
+
+            if (par.include != '\0' && 
+                    strchr(fileWords[i], par.include) == NULL) {
+                continue;
+            }
+
+            if (*wordCount == capacity) {
+                capacity = capacity ? 2 * capacity : 64;
+                indices = (int*)realloc(indices, capacity * sizeof(int));
+            }
+            indices[(*wordCount)++] = i;
+        }
+    }
+    return indices;
+}
+
+// Answers each line of stdin as a new letters arg in '-session' mode
+// Each query's matches are printed like a normal query, followed by an 
+// empty line to mark the end of that query's output
+// Exact queries are each answered from one anagram table kept for the 
+// whole session, other queries update the session's pool of letters
+void run_session(struct Parameters par, char** fileWords, 
+        char** fileWordsCopy, int lineCount, int embedded) {
+
+    struct Session session;
+    struct AnagramTable table;
+    if (par.exact && embedded) {
+        table = embedded_anagram_table();
+    } else if (par.exact) {
+        table = build_anagram_table(fileWordsCopy, lineCount);
+    } else {
+        session = init_session(fileWordsCopy, lineCount, par.pattern, 
+                embedded);
+    }
+    char* letters = strdup(par.letters);
+    size_t size = strlen(letters) + 1;
+
+    do {
+        // Ignores the newline and checks the letters are all alphabetic
+        int valid = 1;
+        letters[strcspn(letters, "\n")] = '\0';
+        for (int i = 0; letters[i] != '\0'; i++) {
+            if (is_not_alpha(letters[i])) {
+                valid = 0;
+            }
+            letters[i] = (char)tolower((int)letters[i]);
+        }
+
+        if (valid) {
+            int wordCount = 0, longestCount = 0;
+            int* indices = (int*)malloc(0);
+
+            if (par.exact) {
+                indices = compare_exact(&table, fileWordsCopy, letters, 
+                        par.pattern, indices, &wordCount, par.include);
+            } else {
+                set_session_letters(&session, letters);
+                indices = compare_session(&session, fileWordsCopy, par, 
+                        indices, &wordCount);
+            }
+
+            char** matchingWords = (char**)malloc(wordCount * sizeof(char*));
+            get_matching_words(fileWords, matchingWords, indices, wordCount);
+            char** longestWords = (char**)malloc(0);
+            longestWords = check_parameters(par, matchingWords, wordCount, 
+                    longestWords, &longestCount);
+
+            free(indices);
+            free_alloc_mem(longestWords, longestCount);
+            free_alloc_mem(matchingWords, wordCount);
+        } else {
+            fprintf(stderr, "unjumble: can only unjumble alphabetic "
+                    "characters\n");
+        }
+        fprintf(stdout, "\n");
+        fflush(stdout);
+    } while (getline(&letters, &size, stdin) != -1);
+
+    free(letters);
+    if (par.exact && !embedded) {
+        free_anagram_table(&table);
+    } else if (!par.exact) {
+        free_session(&session);
+    }
+}
+
+// Frees the memory allocated for the session
+void free_session(struct Session* session) {
+    free(session->deficits);
+    free(session->candidates);
+    free(session->patternMask);
+    for (int c = 0; c < ALPHABET; c++) {
+        free(session->letterIds[c]);
+    }
+}
+
 // Replaces the array of matching words with the original, unmodified word
 void get_matching_words(char** fileWords, char** matchingWords, int* indices, 
         int wordCount) {
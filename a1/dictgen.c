@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Size of the buffers used to store each dictionary word
+#define WORD_SIZE 50
+
+// Number of letters in the alphabet
+#define ALPHABET 26
+
+// Number of bits in each block of a pattern index bitmap
+#define BLOCK_BITS (8 * (int)sizeof(unsigned long))
+
+// Number of values written on each line of a generated array
+#define ROW_VALUES 16
+
+// Function prototypes
+int is_dict_word(char*);
+int word_length(char*);
+void write_words(FILE*, char**, int, char*, int);
+void write_pattern_index(FILE*, char**, int);
+void anagram_key(char*, char*);
+unsigned int hash_key(char*);
+void write_anagram_table(FILE*, char**, int);
+
+// The main function
+// Reads a dictionary file and writes it to stdout as a C header which 
+// unjumble includes when built with the 'embed' make target
+int main(int argc, char** argv) {
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: dictgen dictionary\n");
+        return 1;
+    }
+
+    FILE* wordFile = fopen(argv[1], "r");
+    if (wordFile == NULL) {
+        fprintf(stderr, "dictgen: file \"%s\" can not be opened\n", argv[1]);
+        return 2;
+    }
+
+    // Keeps only the words that unjumble would read from the file
+    char word[WORD_SIZE];
+    char** words = (char**)malloc(0);
+    int wordCount = 0;
+    while (fgets(word, WORD_SIZE, wordFile) != NULL) {
+        if (is_dict_word(word)) {
+            words = (char**)realloc(words, (wordCount + 1) * sizeof(char*));
+            words[wordCount] = strdup(word);
+            wordCount++;
+        }
+    }
+    fclose(wordFile);
+
+    fprintf(stdout, "// Generated by dictgen from \"%s\", do not edit\n\n", 
+            argv[1]);
+    fprintf(stdout, "#define EMBEDDED_COUNT %d\n\n", wordCount);
+    write_words(stdout, words, wordCount, "embeddedWords", 0);
+    write_words(stdout, words, wordCount, "embeddedWordsLower", 1);
+    write_pattern_index(stdout, words, wordCount);
+    write_anagram_table(stdout, words, wordCount);
+
+    for (int i = 0; i < wordCount; i++) {
+        free(words[i]);
+    }
+    free(words);
+    return 0;
+}
+
+// Checks that a line holds at least three letters and no other characters
+// Returns 1 if unjumble would keep the word, else returns 0
+int is_dict_word(char* word) {
+    int len = strlen(word);
+
+    if (len == 0 || word[len - 1] != '\n' || len - 1 < 3) {
+        return 0;
+    }
+
+    for (int i = 0; i < len - 1; i++) {
+        if (!isalpha((int)word[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Gets the number of characters in a dictionary word, excluding the newline
+int word_length(char* word) {
+    int len = 0;
+    while (word[len] != '\n' && word[len] != '\0') {
+        len++;
+    }
+    return len;
+}
+
+// Writes the per-position letter index unjumble uses for '-pattern' queries
+// For each length in turn, 'embeddedPatternIds' lists the words of that 
+// length and 'embeddedPatternBitmaps' holds a bitmap over them for each 
+// (position, letter) pair, with a bit set for each word that has that 
+// letter at that position
+// A final 0 keeps each array from being empty
+void write_pattern_index(FILE* out, char** words, int wordCount) {
+    int counts[WORD_SIZE] = {0};
+
+    for (int i = 0; i < wordCount; i++) {
+        counts[word_length(words[i])]++;
+    }
+
+    fprintf(out, "static const int embeddedPatternCounts[] = {");
+    for (int len = 0; len < WORD_SIZE; len++) {
+        fprintf(out, "%s%d,", len % ROW_VALUES ? " " : "\n    ", counts[len]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    int values = 0;
+    fprintf(out, "static const int embeddedPatternIds[] = {");
+    for (int len = 0; len < WORD_SIZE; len++) {
+        for (int i = 0; i < wordCount; i++) {
+            if (word_length(words[i]) == len) {
+                fprintf(out, "%s%d,", values++ % ROW_VALUES ? " " : "\n    ",
+                        i);
+            }
+        }
+    }
+    fprintf(out, "\n    0\n};\n\n");
+
+    values = 0;
+    fprintf(out, "static const unsigned long embeddedPatternBitmaps[] = {");
+    for (int len = 0; len < WORD_SIZE; len++) {
+        int blocks = (counts[len] + BLOCK_BITS - 1) / BLOCK_BITS;
+        int size = len * ALPHABET * blocks;
+        unsigned long* bitmaps = (unsigned long*)calloc(size, 
+                sizeof(unsigned long));
+
+        // Words are given ids in dictionary order within their length
+        int id = 0;
+        for (int i = 0; i < wordCount; i++) {
+            if (word_length(words[i]) != len) {
+                continue;
+            }
+            for (int pos = 0; pos < len; pos++) {
+                int letter = tolower((int)words[i][pos]) - 'a';
+                bitmaps[(pos * ALPHABET + letter) * blocks + id / BLOCK_BITS] 
+                        |= 1UL << (id % BLOCK_BITS);
+            }
+            id++;
+        }
+
+        for (int b = 0; b < size; b++) {
+            fprintf(out, "%s%#lx,", values++ % ROW_VALUES ? " " : "\n    ", 
+                    bitmaps[b]);
+        }
+        free(bitmaps);
+    }
+    fprintf(out, "\n    0\n};\n\n");
+}
+
+// Writes the words as a constant array of string literals named 'name'
+// The words are changed to lower case if 'lower' is 1
+void write_words(FILE* out, char** words, int wordCount, char* name, 
+        int lower) {
+
+    fprintf(out, "static char* const %s[] = {\n", name);
+    for (int i = 0; i < wordCount; i++) {
+        fprintf(out, "    \"");
+        for (int j = 0; words[i][j] != '\n'; j++) {
+            int c = lower ? tolower((int)words[i][j]) : words[i][j];
+            fputc(c, out);
+        }
+        fprintf(out, "\\n\",\n");
+    }
+    fprintf(out, "};\n\n");
+}
+
+// Writes the anagram key of a word (its letters in lower case and sorted
+// order), the same key unjumble finds for its lower case words
+void anagram_key(char* word, char* key) {
+    int letterCounts[ALPHABET] = {0};
+
+    for (int i = 0; word[i] != '\0'; i++) {
+        if (isalpha((int)word[i])) {
+            letterCounts[tolower((int)word[i]) - 'a']++;
+        }
+    }
+
+    int len = 0;
+    for (int i = 0; i < ALPHABET; i++) {
+        for (int j = 0; j < letterCounts[i] && len < WORD_SIZE - 1; j++) {
+            key[len++] = (char)('a' + i);
+        }
+    }
+    key[len] = '\0';
+}
+
+// Gets the FNV-1a hash of an anagram key, as unjumble does
+unsigned int hash_key(char* key) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; key[i] != '\0'; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Writes the anagram table unjumble uses for '-exact' queries
+// The words in bucket b of the EMBEDDED_ANAGRAM_SIZE buckets are listed in 
+// dictionary order in 'embeddedAnagramIds' from 'embeddedAnagramStarts[b]'
+// up to 'embeddedAnagramStarts[b + 1]'
+void write_anagram_table(FILE* out, char** words, int wordCount) {
+    char key[WORD_SIZE];
+
+    // Uses at least twice as many buckets as words, as unjumble does
+    int size = 1;
+    while (size < 2 * wordCount) {
+        size *= 2;
+    }
+
+    int* starts = (int*)calloc(size + 1, sizeof(int));
+    int* buckets = (int*)malloc(wordCount * sizeof(int));
+    for (int i = 0; i < wordCount; i++) {
+        anagram_key(words[i], key);
+        buckets[i] = hash_key(key) & (size - 1);
+        starts[buckets[i] + 1]++;
+    }
+    for (int b = 1; b <= size; b++) {
+        starts[b] += starts[b - 1];
+    }
+
+    fprintf(out, "#define EMBEDDED_ANAGRAM_SIZE %d\n\n", size);
+    fprintf(out, "static const int embeddedAnagramStarts[] = {");
+    for (int b = 0; b <= size; b++) {
+        fprintf(out, "%s%d,", b % ROW_VALUES ? " " : "\n    ", starts[b]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    // Places each word after the words before it in its bucket
+    int* ids = (int*)malloc(wordCount * sizeof(int));
+    for (int i = 0; i < wordCount; i++) {
+        ids[starts[buckets[i]]++] = i;
+    }
+
+    fprintf(out, "static const int embeddedAnagramIds[] = {");
+    for (int i = 0; i < wordCount; i++) {
+        fprintf(out, "%s%d,", i % ROW_VALUES ? " " : "\n    ", ids[i]);
+    }
+    fprintf(out, "\n    0\n};\n");
+
+    free(starts);
+    free(buckets);
+    free(ids);
+}
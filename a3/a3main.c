@@ -1,81 +1,690 @@
+// pipe2(), tee(), splice() and sched_setaffinity() are GNU extensions
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <limits.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
 #include <signal.h>
+#include <spawn.h>
+#include <sched.h>
 #include <time.h>
 #include <csse2310a3.h>
 
+// number of bits in each word of the invalid jobs bitset
+#define WORD_BITS (8 * (int)sizeof(unsigned long))
+
+// default time in ms between sending SIGABRT and SIGKILL to a timed out job
+#define DEFAULT_GRACE 1000
+
+// states of a job while it is being waited for
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_ABORTED 2
+#define JOB_KILLED 3
+#define JOB_DONE 4
+
+// pid map slots which are empty or whose job has been reaped
+#define PID_EMPTY -1
+#define PID_REMOVED -2
+
+// number of jobs listed for each resource in the -stats summary
+#define TOP_JOBS 5
+
+// epoll events are tagged with their type in the low EVENT_BITS bits and 
+// the index of their relay or capture stream above them
+#define EVENT_SIGNAL 0
+#define EVENT_TIMER 1
+#define EVENT_RELAY 2
+#define EVENT_CAPTURE 3
+#define EVENT_INTAKE 4
+#define EVENT_STDOUT 5
+#define EVENT_BITS 3
+#define MAX_EVENTS 64
+
+// most bytes a relay moves in one tee() or splice()
+#define RELAY_CHUNK 65536
+
+// most bytes read from a captured stream at once, longest line written to 
+// the merged output before it is split and the size of each per-job log
+#define CAPTURE_CHUNK 65536
+#define CAPTURE_LINE 4096
+#define LOG_LIMIT (1024 * 1024)
+// most bytes of merged output waiting for stdout before captured streams
+// stop being read, and the size it must fall to before they are read again
+#define MERGED_LIMIT (1024 * 1024)
+#define MERGED_RESUME (MERGED_LIMIT / 2)
+
+// initial size of the buffer holding a partial line read from a stream
+#define INTAKE_CHUNK 4096
+
+// most jobs of a streamed sweep admitted ahead of those already launched
+#define SWEEP_AHEAD 256
+
+// nice value of a job without a nice= attribute, outside the valid range
+#define NICE_UNSET 20
+
+// I/O scheduling classes and priority format for ioprio_set(), which glibc 
+// has no wrapper or header for
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+// bytes read or copied at once when hashing input files and copying output
+// files for -cache
+#define CACHE_CHUNK 65536
+
+// least time in ms between reads of the pressure on the host with -throttle,
+// whose averages are only updated every few seconds by the kernel
+#define THROTTLE_INTERVAL 1000
+
+// root of the cgroup v2 hierarchy
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+// period in us over which a job's cpurate= is enforced by cpu.max
+#define CPU_PERIOD 100000
+
+// largest pipe buffer in bytes if /proc/sys/fs/pipe-max-size can not be read
+#define DEFAULT_PIPE_MAX (1024 * 1024)
+
+// events recorded for each job by -trace
+#define TRACE_PARSED 0
+#define TRACE_QUEUED 1
+#define TRACE_SPAWN 2
+#define TRACE_SPAWNED 3
+#define TRACE_ABORTED 4
+#define TRACE_KILLED 5
+#define TRACE_REAPED 6
+#define TRACE_SKIPPED 7
+#define TRACE_TYPES 8
+// jobs the trace first has room for, it at least doubles each time it grows
+#define TRACE_CHUNK 4096
+
+// command line options data structure
+// "first" is the position of the first jobfile in the command line,
+// "grace" is the time in ms between SIGABRT and SIGKILL for timed out jobs
+// "jobLimit" is the most jobs that may run at once (0 for no limit), 
+// "stats" prints the resources used by each job and a summary at the end,
+// "capture" collects the output of each job, into the directory "logDir" if 
+// it is not NULL, "stream" reads the one jobfile while its jobs run and 
+// "pin" spreads the jobs across the cpus jobrunner may use
+// "tracePath" is the file -trace writes a timeline of the jobs to (NULL if 
+// not tracing) and "pipeSize" the buffer size in bytes of every pipe (0 for
+// the kernel's default)
+// "cgroup" puts each job with mem= or cpurate= in a cgroup of its own and
+// "cacheDir" is the directory -cache keeps job results in (NULL if not 
+// caching)
+// "cpuPressure" and "memPressure" are the percents of cpu and memory 
+// pressure above which -throttle pauses launches (0 if not throttling)
+typedef struct Options {
+    int verbose;
+    int grace;
+    int jobLimit;
+    int stats;
+    int capture;
+    char* logDir;
+    int stream;
+    int pin;
+    char* tracePath;
+    int pipeSize;
+    int cgroup;
+    char* cacheDir;
+    int cpuPressure;
+    int memPressure;
+    int first;
+} Options;
+
 // pipe data structure
+// "name" points into the line of the first job to use the pipe, "writer" and
+// "reader" are the indices of the jobs at each end (-1 if there are none)
+// a pipe may have several readers, "reader" is the last of them and the rest
+// are linked through each job's "nextReader"
+// "size" is the buffer size in bytes the kernel gave the pipe when it was 
+// resized (0 if it kept the default size)
 typedef struct Pipe {
     char* name;
-    int number;
-    int input;
-    int output;
+    int writer;
+    int reader;
+    int readerCount;
     int error;
+    int size;
+    int fd[2];
 } Pipe;
 
+// pipe table data structure, holds every pipe named in the jobfiles
+// "buckets" is an open addressing hash table from pipe names to indices in
+// "pipes" (-1 if empty), "bucketCount" is a power of 2
+typedef struct PipeTable {
+    Pipe* pipes;
+    int count;
+    int size;
+    int* buckets;
+    int bucketCount;
+} PipeTable;
+
+// usage data structure
+// resources used by a job as reported by wait4(), times are in ms and 
+// "maxRss" is in KB, "wall" is -1 until the job has been reaped
+typedef struct Usage {
+    long long wall;
+    long long user;
+    long long system;
+    long maxRss;
+    long voluntary;
+    long involuntary;
+} Usage;
+
+// job data structure, created once for each job line in the jobfiles
+// "line" holds the text of every field, "argv" is the NULL terminated 
+// command and arguments, "input" and "output" are the stdin and stdout 
+// fields and "timeoutText" is the timeout field (NULL if not given)
+// "after" is the list of jobs this job depends on (NULL if not given)
+// "inPipe" and "outPipe" are indices in the pipe table (-1 if not a pipe)
+// "fanFd" is this job's own pipe from the relay when it is one of several 
+// readers of its input pipe (-1 if not used)
+// "result" is 1 once the job has succeeded, 0 once it has failed or been 
+// skipped and -1 before then
+// "cpus", "nice" and "ioprio" are set by the job's attributes (NULL, 
+// NICE_UNSET and -1 if not given), "cpu" is the cpu chosen by -pin (-1 if 
+// not pinned) and "pipeSize" the buffer size of its output pipe (0 if not 
+// given)
+// "memLimit" and "fileLimit" are its limits in bytes on memory and on the 
+// size of files it writes, "cpuLimit" its limit in seconds on cpu time and
+// "cpuRate" the percent of a cpu its cgroup may use (0 if not given)
+// "cgroupFd" is the cgroup.procs file of its cgroup while it is spawned (-1
+// if it has no cgroup)
+// "hash" is the hash of its command and input used by -cache (0 if it is 
+// not cached)
+// "sweep" is set for a job expanded from a sweep by the event loop, which 
+// leaves the job table once it has finished unless it uses a pipe
+typedef struct Job {
+    char* line;
+    char** argv;
+    char* input;
+    char* output;
+    char* timeoutText;
+    char* after;
+    int timeout;
+    int inPipe;
+    int outPipe;
+    int nextReader;
+    int fanFd[2];
+    int number;
+    int result;
+    char* cpus;
+    int nice;
+    int ioprio;
+    int cpu;
+    int pipeSize;
+    long long memLimit;
+    long long fileLimit;
+    int cpuLimit;
+    int cpuRate;
+    int cgroupFd;
+    unsigned long long hash;
+    pid_t pid;
+    long long start;
+    Usage usage;
+    int sweep;
+} Job;
+
+// totals data structure, the resources used by the jobs that were reaped
+// for the -stats summary, with the TOP_JOBS job numbers which used the most 
+// cpu time and memory in "cpuJobs" and "rssJobs"
+typedef struct Totals {
+    int count;
+    long long user;
+    long long system;
+    int cpuJobs[TOP_JOBS];
+    long long cpuTimes[TOP_JOBS];
+    int cpuCount;
+    int rssJobs[TOP_JOBS];
+    long long rssSizes[TOP_JOBS];
+    int rssCount;
+} Totals;
+
+// job table data structure, holds every job from every jobfile in order
+// "numbers" is the number of jobs added, the finished jobs of a sweep leave
+// the table with their usage added to "retired" and the "spareCount" 
+// indices they leave in "spares" are reused before the table grows, so 
+// jobs admitted by the event loop are not always at index number - 1
+typedef struct JobTable {
+    Job* jobs;
+    int count;
+    int size;
+    int numbers;
+    int* spares;
+    int spareCount;
+    Totals retired;
+} JobTable;
+
 // invalid jobs data structure
+// bitset with a bit set for each invalid job number
 typedef struct InvalidJobs {
-    int* invJobs;
+    unsigned long* invJobs;
+    int size;
     int invjobCount;
 } InvalidJobs;
 
-// pipes file descriptors data structure
-typedef struct FdPipes {
-    int** fd;
-} FdPipes;
-
-// timeout data structure
-typedef struct Timeouts {
-    int* times;
-} Timeouts;
+// pid map data structure
+// hash table from the pid of each running job to its index in the job table
+// reaped jobs are marked PID_REMOVED so that a reused pid is never confused
+// with an earlier job, "count" is the number of pids in the map and "used" 
+// the number of slots which are not PID_EMPTY
+typedef struct PidMap {
+    pid_t* pids;
+    int* indices;
+    int size;
+    int count;
+    int used;
+} PidMap;
+
+// job state data structure used while waiting for jobs
+// "states" holds the JOB_ state of each job in the job table
+// the "running" jobs that have been spawned and not reaped are listed in 
+// "runningJobs", and "slots" holds the position of each one in that list so
+// it can be removed in O(1)
+// "queued", "succeeded", "failed" and "skipped" count the jobs in each state
+// for the status printed on SIGUSR1
+typedef struct JobStates {
+    int* states;
+    int* runningJobs;
+    int* slots;
+    int running;
+    int killedAll;
+    int queued;
+    int succeeded;
+    int failed;
+    int skipped;
+} JobStates;
+
+// scheduler data structure
+// valid jobs connected by pipes form a unit which is always launched at once
+// "firsts" and "sizes" hold the first job and number of jobs of each unit in
+// job order, "nextJobs" links each job to the next job in its unit (-1 at 
+// the end) and "unitOf" is the unit of each job (-1 if the job is invalid)
+// "waiting" is the number of dependencies of each unit that have not exited
+// yet (-1 once the unit is skipped) and the units depending on job i are 
+// listed in "depUnits" from edge depHeads[i] through "depNexts" (-1 at the 
+// end), "depTails" holds the last edge of each list
+// units whose dependencies have all exited successfully are queued in 
+// "ready" and launched in order, "skipped" is a stack of units to be skipped
+// "incoming" is the number of edges to each unit not followed yet, edges 
+// are freed onto the list from "freeEdge" once followed, and the units left
+// by jobs of a sweep are listed in "spareUnits" for form_unit() to reuse
+typedef struct Scheduler {
+    int* firsts;
+    int* sizes;
+    int* nextJobs;
+    int* unitOf;
+    int* waiting;
+    int* depHeads;
+    int* depTails;
+    int* depNexts;
+    int* depUnits;
+    int* incoming;
+    int edgeCount;
+    int edgeSize;
+    int freeEdge;
+    int* spareUnits;
+    int spareUnitCount;
+    int* ready;
+    int* skipped;
+    int readyHead;
+    int readyTail;
+    int unitCount;
+    int limit;
+} Scheduler;
+
+// deadline data structure
+// binary min heap of the CLOCK_MONOTONIC times in ms at which each job must
+// next be signalled, the earliest of which is armed on a timerfd
+// the number of each job is kept with its index, as the index may belong to
+// a later job by the time the deadline comes
+typedef struct Deadlines {
+    long long* times;
+    int* jobs;
+    int* numbers;
+    int count;
+    int size;
+} Deadlines;
+
+// relay data structure
+// copies everything written to a pipe with several readers into a pipe for 
+// each reader with tee() and splice(), so the data never enters user space
+// stage i tees its input "ins[i]" into "tees[i]", then splices the same 
+// "pending[i]" bytes on to "nexts[i]", which is the input of the next stage 
+// or the last reader's pipe for the last stage
+// "tees[i]" is -1 once that reader has exited (or if there is one reader) and
+// "ins[i]" is -1 once the stage has finished, "alive" is the number of 
+// readers that have not exited
+typedef struct Relay {
+    int* ins;
+    int* tees;
+    int* nexts;
+    size_t* pending;
+    int count;
+    int alive;
+} Relay;
+
+// capture data structure
+// "fds" are the read ends of the pipes capturing a job's stdout and stderr
+// and "childFds" the write ends given to the job (-1 if not captured)
+// "lines" holds the last partial line of each stream for the merged output,
+// "logFd" is the job's log file and "logged" the bytes written to it
+typedef struct Capture {
+    int fds[2];
+    int childFds[2];
+    char* lines[2];
+    int lengths[2];
+    int logFd;
+    long logged;
+} Capture;
+
+// merged output data structure, holds the captured lines waiting to be 
+// written to stdout, which is non-blocking with -capture so that a slow 
+// reader of jobrunner's output never stalls the event loop
+// "buffer" holds the "length" bytes not yet written, "flags" are the file 
+// status flags stdout had before, "watched" is set while the event loop 
+// waits for stdout to accept more and "paused" while captured streams are 
+// not read because MERGED_LIMIT bytes are waiting
+typedef struct Merged {
+    char* buffer;
+    int length;
+    int size;
+    int flags;
+    int watched;
+    int paused;
+} Merged;
+
+// trace data structure
+// "times" holds the time in us since "origin" at which each TRACE_ event 
+// happened to each job (-1 if it has not), it grows as jobs are added to 
+// the job table, never when an event is recorded
+typedef struct Trace {
+    FILE* file;
+    long long* times;
+    int size;
+    long long origin;
+} Trace;
+
+// sweep data structure, expands one jobfile line into a job for every 
+// combination of the values of its variables
+// "line" is the line without its "{name}=values" attributes, "names" and 
+// "values" point into "text" and "positions" holds the index of the current
+// value of each of the "count" variables, which is written to "current"
+// "remaining" is the number of jobs still to be expanded
+typedef struct Sweep {
+    char* line;
+    char* text;
+    char** names;
+    char** values;
+    char** current;
+    int* sizes;
+    int* positions;
+    int count;
+    int remaining;
+} Sweep;
+
+// intake data structure, reads a jobfile from stdin or a FIFO while its jobs
+// are running
+// "buffer" holds the "length" bytes read after the last complete line and
+// "line" is the number of the next line in the jobfile
+// jobs sharing pipes are joined into groups with the union-find "parents", 
+// whose roots hold the first job of their group in "heads", and a group 
+// becomes a unit once every pipe it uses has a writer and a reader
+// the jobs of a "sweep" on line "sweepLine" are admitted as earlier jobs are
+// launched, the lines after it wait in "buffer" until it is finished (its 
+// "count" is 0 when there is none), "ended" is set at the end of the jobfile
+// without -stream the intake takes over at the first sweep, and "files" 
+// lists the "fileCount" jobfiles still to be read after this one
+// jobs numbered up to "base" were read before the intake, at index number - 1,
+// "jobMap" maps the number of each job it admitted to its index in the pid 
+// map's hash table, and "failedJobs" has a bit set, as for the invalid jobs,
+// for each job of a sweep which failed or was skipped and left the table
+typedef struct Intake {
+    int fd;
+    char* name;
+    char** files;
+    int fileCount;
+    char* buffer;
+    int length;
+    int size;
+    int line;
+    int verbose;
+    int* parents;
+    int* heads;
+    InvalidJobs* invalidJobs;
+    Sweep sweep;
+    int sweepLine;
+    int ended;
+    int base;
+    PidMap jobMap;
+    InvalidJobs failedJobs;
+} Intake;
+
+// runner data structure, holds the state of the event loop which launches
+// jobs and waits for them
+// "size" is the number of jobs the arrays indexed by job or unit can hold
+// with -pin "cores" lists the "coreCount" cpus jobs may be pinned to, 
+// "coreJobs" is the number of running jobs pinned to each cpu and 
+// "nextCore" the position in "cores" after the last one picked
+// "pipeSize" is the buffer size for pipes from -pipesize (0 if not given) 
+// and "pipeMax" the largest buffer size a pipe may be given
+// "cgroup" is the cgroup directory in which each job's cgroup is made (NULL 
+// if cgroups are not used), "cgroupHome" the cgroup jobrunner was started 
+// in and "cacheDir" the directory of cached results
+// "cpuPressure" and "memPressure" are the thresholds from -throttle (0 if 
+// not throttling), "throttled" is set while launches are paused and 
+// "throttleChecked" is when the pressure was last read
+// "merged" is the output of -capture waiting to be written to stdout
+typedef struct Runner {
+    int epollFd;
+    int sigFd;
+    int timerFd;
+    int grace;
+    int stats;
+    PidMap pidMap;
+    JobStates states;
+    Deadlines deadlines;
+    Scheduler* scheduler;
+    Relay* relays;
+    int relayCount;
+    Capture* captures;
+    Merged merged;
+    char* logDir;
+    Intake* intake;
+    int size;
+    int* cores;
+    int coreCount;
+    int* coreJobs;
+    int nextCore;
+    Trace* trace;
+    int pipeSize;
+    int pipeMax;
+    char* cgroup;
+    char* cgroupHome;
+    char* cacheDir;
+    int cpuPressure;
+    int memPressure;
+    int throttled;
+    long long throttleChecked;
+} Runner;
 
 // function declarations
 void signal_handler(void);
-int check_args(int, char** argv);
-int check_verbose(int);
+void check_args(int, char** argv, Options*);
+int check_number(char*);
 void check_files(int, char** argv, int);
-void check_valid_pipes(Pipe*, int*, int*);
-Pipe* read_file(char*, int*, InvalidJobs*, int*, Pipe*);
+void file_error(char*);
+int read_file(char*, JobTable*, PipeTable*, InvalidJobs*, Trace*, Intake*);
+int check_line(char*);
+int check_fields(char*);
+int add_job(char*, JobTable*, PipeTable*, InvalidJobs*, Trace*);
+int start_sweep(char*, Sweep*);
+int add_variable(Sweep*, char*);
+int sweep_size(char*);
+int sweep_range(char*, int, int*, int*);
+void sweep_value(char*, int, char*);
+char* next_sweep_line(Sweep*);
+void end_sweep(Sweep*);
 int check_stdin(char** line);
 int check_stdout(char** line);
 int check_timeout(char** line);
-void check_pipe(char** line, int*, int*, Pipe*, InvalidJobs*);
-void check_pipe_input(char** line, int*, int*, Pipe*, InvalidJobs*, 
-        int*, int*);
-void check_pipe_output(char** line, int*, int*, Pipe*, InvalidJobs*, 
-        int*, int*);
-void check_invalid_pipe(Pipe*, int, int*, int*, InvalidJobs*);
+int check_attributes(char*, Job*);
+int check_after(char*);
+int check_cpus(char*, cpu_set_t*);
+int check_nice(char*);
+int check_ioprio(char*);
+long long check_size(char*);
+void check_pipe(JobTable*, int, PipeTable*, InvalidJobs*);
+int find_pipe(PipeTable*, char*);
+unsigned int hash_name(char*);
+void grow_pipe_buckets(PipeTable*);
+void add_invalid_job(InvalidJobs*, int);
+int is_invalid_job(InvalidJobs*, int);
+void check_invalid_pipe(JobTable*, PipeTable*, InvalidJobs*);
 void invalid_line(int, char*);
 void invalid_read(char*);
 void invalid_write(char*);
-void verbose_mode(char*, InvalidJobs*, Timeouts*, int, int*, int*);
-char* insert_time(char*, int, int);
+void verbose_mode(JobTable*, InvalidJobs*, int);
+void verbose_job(Job*);
 void check_jobs(int);
-void create_pipes(int, FdPipes*);
-void reassign_pipe_numbers(Pipe*, int*);
-int* setup_processes(int, int*, FdPipes*, Pipe*, int*, int, int, char**, int*, 
-        InvalidJobs*, pid_t*, Timeouts*, time_t*, int*, int*, int*);
-int* create_process(char*, Pipe*, FdPipes*, int*, int*, int*, InvalidJobs*, 
-        pid_t*, Timeouts*, time_t*, int*, int*, int*);
-void wait_for_process(pid_t*, Timeouts*, int, int*, time_t*, FdPipes*, int);
-void prepare_for_wait(FdPipes*, int);
-void exit_status(int*, int, int, int*, int*);
-int exec_job(char** line, Pipe*, FdPipes*, int*, int);
-void close_pipe_fds(FdPipes*, int);
-void assign_pipes(char*, Pipe*, FdPipes*, int*, int);
-void free_alloc_mem(int, int, Pipe*, FdPipes*, pid_t*, InvalidJobs*, Timeouts*,
-        time_t*, int*);
+int setup_processes(JobTable*, InvalidJobs*, Scheduler*, int);
+void find_units(JobTable*, PipeTable*, InvalidJobs*, Scheduler*);
+int find_root(int*, int);
+void check_dependencies(JobTable*, InvalidJobs*, Scheduler*);
+void add_dependencies(JobTable*, Scheduler*, int*, int*);
+void add_edge(Scheduler*, int, int);
+void free_edges(Scheduler*, int);
+int next_dependency(char**);
+void remove_units(JobTable*, InvalidJobs*, Scheduler*, int*);
+void launch_units(Runner*, JobTable*, PipeTable*);
+void queue_unit(Runner*, int);
+void launch_unit(Runner*, JobTable*, PipeTable*, int);
+int cacheable(Job*);
+unsigned long long hash_job(Job*);
+int load_cache(Runner*, JobTable*, int);
+void store_cache(Runner*, Job*, int);
+int copy_file(char*, char*);
+void create_pipes(Runner*, JobTable*, PipeTable*, int);
+void resize_pipe(Runner*, Pipe*, int*, int);
+int read_pipe_max(void);
+void close_job_pipes(Scheduler*, PipeTable*, int, Job*);
+void start_relay(Runner*, JobTable*, PipeTable*, int);
+void pump_relay(Relay*);
+int pump_stage(Relay*, int);
+void close_relay(Relay*);
+void create_process(Job*, PipeTable*, Capture*);
+int needs_fork(Job*);
+int set_scheduling(Job*);
+int set_limits(Job*);
+void setup_cgroup(Runner*);
+void remove_cgroup(Runner*, JobTable*);
+int write_cgroup(char*, char*, char*);
+int uses_cgroup(Runner*, Job*);
+void cgroup_path(Runner*, Job*, char*, int);
+void open_cgroup(Runner*, Job*);
+int close_cgroup(Runner*, Job*);
+void find_cores(Runner*);
+int pick_core(Runner*);
+int check_throttle(Runner*);
+double read_pressure(char*);
+double read_load(void);
+pid_t spawn_job(Job*, PipeTable*, Capture*);
+void open_capture(Capture*, Job*, char*);
+void watch_capture(Runner*, int);
+int read_capture(Runner*, JobTable*, int, int);
+void drain_capture(Runner*, JobTable*, int);
+void close_capture(Merged*, Capture*, int, int);
+void write_lines(Merged*, Capture*, int, int, char*, int);
+void open_merged(Merged*, int);
+void flush_merged(Runner*);
+void pause_captures(Runner*, int);
+void close_merged(Merged*);
+void write_log(Capture*, char*, int);
+void block_signals(void);
+void unblock_signals(void);
+long long wait_for_process(JobTable*, PipeTable*, Scheduler*, Options*, 
+        Intake*, Trace*);
+int setup_event_loop(int*, int*);
+void open_intake(Intake*, char*, InvalidJobs*, int);
+void init_intake(Intake*, int, char*, InvalidJobs*, int);
+void watch_intake(Runner*, JobTable*, PipeTable*);
+void read_intake(Runner*, JobTable*, PipeTable*);
+void admit_lines(Runner*, JobTable*, PipeTable*);
+int next_jobfile(Runner*, JobTable*, PipeTable*);
+void feed_sweep(Runner*, JobTable*, PipeTable*);
+void admit_line(Runner*, JobTable*, PipeTable*, char*);
+void admit_job(Runner*, JobTable*, PipeTable*, int);
+int check_stream_pipes(Runner*, JobTable*, PipeTable*, int);
+void join_groups(Runner*, JobTable*, int, int);
+void complete_group(Runner*, JobTable*, PipeTable*, int);
+void form_unit(Runner*, JobTable*, int);
+int find_job(Runner*, int);
+void retire_job(Runner*, JobTable*, int);
+void close_intake(Runner*, JobTable*, PipeTable*);
+void grow_runner(Runner*, int);
+void create_pid_map(PidMap*, int);
+void grow_pid_map(PidMap*, int);
+void add_pid(PidMap*, pid_t, int);
+int find_pid(PidMap*, pid_t, int);
+long long current_ms(void);
+long long current_us(void);
+void grow_trace(Trace*, int);
+void trace_event(Trace*, int, int);
+void start_trace(Trace*);
+void write_trace(Trace*, JobTable*, PipeTable*);
+void write_job_trace(Trace*, Job*, int);
+void write_slice(Trace*, int, char*, long long, long long);
+void write_json(FILE*, char*);
+void push_deadline(Deadlines*, long long, int, int);
+void pop_deadline(Deadlines*);
+void grow_deadlines(Deadlines*);
+void prune_deadlines(Runner*, JobTable*);
+void arm_timer(int, Deadlines*);
+void check_timeouts(Runner*, JobTable*);
+int read_signals(int);
+void add_running(JobStates*, int);
+void remove_running(JobStates*, int);
+void print_status(Runner*, JobTable*);
+void reap_children(Runner*, JobTable*);
+void finish_job(Runner*, JobTable*, int, int);
+int skip_unit(Runner*, JobTable*, int, int);
+void prepare_for_wait(void);
+void exit_status(int, int, int);
+void record_usage(Job*, struct rusage*);
+void print_usage(Job*);
+void print_summary(JobTable*, PipeTable*, long long);
+void add_usage(Totals*, Job*);
+void insert_top(int*, long long*, int*, int, long long);
+void exec_job(Job*, PipeTable*, Capture*);
+void close_pipe(Pipe*);
+void assign_pipes(Job*, PipeTable*, int);
+int find_pipe_fd(Job*, PipeTable*, int);
+void free_alloc_mem(JobTable*, PipeTable*, InvalidJobs*, Scheduler*);
 
 // global variable for sighup signal
 int sighup = 0;
 
+// environment passed to spawned jobs
+extern char** environ;
+
 // handle sighup signal
 void handle_sighup(int s) {
     sighup = 1;
@@ -86,65 +695,99 @@ int main(int argc, char** argv) {
 
     signal_handler();
 
-    int verbose = check_args(argc, argv);
-    int count = check_verbose(verbose);
+    Options options;
+    check_args(argc, argv, &options);
+    if (!options.stream) {
+        check_files(argc, argv, options.first);
+    }
 
-    check_files(argc, argv, count);
+    Trace trace;
+    Trace* tracer = NULL;
+    if (options.tracePath != NULL) {
+        trace.file = fopen(options.tracePath, "w");
+        if (trace.file == NULL) {
+            file_error(options.tracePath);
+        }
+        trace.times = (long long*)malloc(0);
+        trace.size = 0;
+        trace.origin = current_us();
+        tracer = &trace;
+        start_trace(tracer);
+    }
 
-    Pipe* pipes = (Pipe*)malloc(0);
-    int pipeCount = 1, jobCount = 0, validPipes = 0;
+    JobTable table;
+    table.jobs = (Job*)malloc(0);
+    table.count = 0;
+    table.size = 0;
+    table.numbers = 0;
+    table.spares = (int*)malloc(0);
+    table.spareCount = 0;
+    memset(&table.retired, 0, sizeof(table.retired));
+
+    PipeTable pipes;
+    pipes.pipes = (Pipe*)malloc(0);
+    pipes.count = 0;
+    pipes.size = 0;
+    pipes.buckets = (int*)malloc(0);
+    pipes.bucketCount = 0;
 
     InvalidJobs invalidJobs;
     invalidJobs.invjobCount = 0;
-    invalidJobs.invJobs = (int*)malloc(sizeof(int));
-
-    for (int i = count; i < argc; i++) {
-        pipes = read_file(argv[i], &jobCount, &invalidJobs, 
-                &pipeCount, pipes);
+    invalidJobs.size = 0;
+    invalidJobs.invJobs = (unsigned long*)malloc(0);
+
+    // each jobfile is read and split into the job table exactly once, a 
+    // streamed jobfile is read by the event loop as its jobs run instead, as
+    // is everything from the first sweep on, whose lines are only checked
+    Intake intake;
+    Intake* stream = NULL;
+    if (options.stream) {
+        open_intake(&intake, argv[options.first], &invalidJobs, 
+                options.verbose);
+        stream = &intake;
+    } else {
+        for (int i = options.first; i < argc; i++) {
+            if (read_file(argv[i], &table, &pipes, &invalidJobs, tracer, 
+                    stream == NULL ? &intake : NULL)) {
+                intake.verbose = options.verbose;
+                intake.files = argv + i + 1;
+                intake.fileCount = argc - i - 1;
+                stream = &intake;
+            }
+        }
     }
 
-    check_invalid_pipe(pipes, pipeCount, &validPipes, &jobCount, 
-            &invalidJobs);
-
-    int execCount = jobCount - invalidJobs.invjobCount;
+    check_invalid_pipe(&table, &pipes, &invalidJobs);
 
-    Timeouts timeouts;
-    timeouts.times = (int*)malloc(execCount * sizeof(int));
+    Scheduler scheduler;
+    find_units(&table, &pipes, &invalidJobs, &scheduler);
+    check_dependencies(&table, &invalidJobs, &scheduler);
+    verbose_mode(&table, &invalidJobs, options.verbose);
 
-    int timeCount = 1, invalidCount = 0;
-    for (int i = count; i < argc; i++) {
-        verbose_mode(argv[i], &invalidJobs, &timeouts, verbose, &timeCount, 
-                &invalidCount);
-    }
+    block_signals();
+    int execCount = setup_processes(&table, &invalidJobs, &scheduler, 
+            options.jobLimit);
 
-    FdPipes fdPipes;
-    fdPipes.fd = (int**)malloc(validPipes * sizeof(int*));
+    if (execCount > 0 || stream != NULL) {
+        long long makespan = wait_for_process(&table, &pipes, &scheduler, 
+                &options, stream, tracer);
 
-    for (int i = 0; i < validPipes; i++) {
-        fdPipes.fd[i] = (int*)malloc(2 * sizeof(int));
+        if (options.stats) {
+            print_summary(&table, &pipes, makespan);
+        }
     }
 
-    int jobNumber = 0, execNumber = 0, execFail = 0;
-    pid_t* pids = (pid_t*)malloc(execCount * sizeof(pid_t));
-    time_t* times = (time_t*)malloc(execCount * sizeof(time_t));
-    int* validJobNumbers = malloc(0);
-
-    validJobNumbers = setup_processes(execCount, &validPipes, &fdPipes, pipes, 
-            &pipeCount, count, argc, argv, &jobNumber, &invalidJobs, pids, 
-            &timeouts, times, validJobNumbers, &execNumber, &execFail);
-
-    if (!execFail) {
-        wait_for_process(pids, &timeouts, execCount, validJobNumbers, times, 
-                &fdPipes, validPipes);
+    if (stream != NULL) {
+        execCount = table.numbers - invalidJobs.invjobCount;
     }
 
-    free_alloc_mem(pipeCount, validPipes, pipes, &fdPipes, pids, &invalidJobs, 
-            &timeouts, times, validJobNumbers);
-
-    if (execFail) {
-        return 255;
+    if (tracer != NULL) {
+        write_trace(tracer, &table, &pipes);
+        fclose(trace.file);
+        free(trace.times);
     }
 
+    free_alloc_mem(&table, &pipes, &invalidJobs, &scheduler);
     check_jobs(execCount);
     return 0;
 }
@@ -158,27 +801,108 @@ void signal_handler(void) {
     sa.sa_handler = handle_sighup;
     sa.sa_flags = SA_RESTART;
     sigaction(SIGHUP, &sa, NULL);
+
+    // a SIGUSR1 sent while the jobfiles are read would otherwise kill 
+    // jobrunner, it is kept pending until the event loop reads it instead
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
 }
 
 // checks command line arguements
 // takes "argc" and "argv" (command line args) as parameters
-// returns 1 if "-v" is specified, else returns 0
-int check_args(int argc, char** argv) {
-
-    char* invErrMsg = "Usage: jobrunner [-v] jobfile [jobfile ...]";
-    int error = 0;
-    int verbose = 0;
-
-    for (int i = 0; i < argc; i++) {
-        if (strcmp(argv[i], "-v") == 0) {
-            if (i != 1) {
+// fills in the "options" data struct, options must come before the jobfiles
+void check_args(int argc, char** argv, Options* options) {
+
+    char* invErrMsg = "Usage: jobrunner [-v] [-grace ms] [-j N] [-stats] "
+            "[-capture|-logs dir] [-stream] [-pin] [-trace file] "
+            "[-pipesize bytes] [-cgroup] [-cache dir] [-throttle cpu[/mem]] "
+            "jobfile [jobfile ...]";
+    int error = 0, i;
+    struct stat info;
+    char* slash;
+
+    options->verbose = 0;
+    options->grace = DEFAULT_GRACE;
+    options->jobLimit = 0;
+    options->stats = 0;
+    options->capture = 0;
+    options->logDir = NULL;
+    options->stream = 0;
+    options->pin = 0;
+    options->tracePath = NULL;
+    options->pipeSize = 0;
+    options->cgroup = 0;
+    options->cacheDir = NULL;
+    options->cpuPressure = 0;
+    options->memPressure = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-v") == 0 && !options->verbose) {
+            options->verbose = 1;
+        } else if (strcmp(argv[i], "-grace") == 0 && i + 1 < argc &&
+                check_number(argv[i + 1]) != -1) {
+            options->grace = check_number(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc &&
+                check_number(argv[i + 1]) > 0) {
+            options->jobLimit = check_number(argv[++i]);
+        } else if (strcmp(argv[i], "-stats") == 0 && !options->stats) {
+            options->stats = 1;
+        } else if (strcmp(argv[i], "-capture") == 0 && !options->capture) {
+            options->capture = 1;
+        } else if (strcmp(argv[i], "-logs") == 0 && i + 1 < argc && 
+                !options->capture && stat(argv[i + 1], &info) == 0 && 
+                S_ISDIR(info.st_mode)) {
+            options->capture = 1;
+            options->logDir = argv[++i];
+        } else if (strcmp(argv[i], "-stream") == 0 && !options->stream) {
+            options->stream = 1;
+        } else if (strcmp(argv[i], "-pin") == 0 && !options->pin) {
+            options->pin = 1;
+        } else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc && 
+                options->tracePath == NULL) {
+            options->tracePath = argv[++i];
+        } else if (strcmp(argv[i], "-pipesize") == 0 && i + 1 < argc && 
+                check_size(argv[i + 1]) > 0 && 
+                check_size(argv[i + 1]) <= INT_MAX) {
+            options->pipeSize = (int)check_size(argv[++i]);
+        } else if (strcmp(argv[i], "-cgroup") == 0 && !options->cgroup) {
+            options->cgroup = 1;
+        } else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc && 
+                options->cacheDir == NULL && stat(argv[i + 1], &info) == 0 &&
+                S_ISDIR(info.st_mode)) {
+            options->cacheDir = argv[++i];
+        } else if (strcmp(argv[i], "-throttle") == 0 && i + 1 < argc && 
+                options->cpuPressure == 0) {
+            // the memory threshold is the same as the cpu one if not given
+            i++;
+            slash = strchr(argv[i], '/');
+            if (slash != NULL) {
+                *slash = '\0';
+            }
+            options->cpuPressure = check_number(argv[i]);
+            options->memPressure = slash != NULL ? check_number(slash + 1) :
+                    options->cpuPressure;
+            if (options->cpuPressure <= 0 || options->memPressure <= 0) {
                 error = 1;
+                break;
             }
-            verbose = 1;
+        } else {
+            break;
         }
     }
+    options->first = i;
 
-    if ((argc == 1) || ((argc == 2) && verbose)) {
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            error = 1;
+        }
+    }
+
+    // a streamed jobfile must be the only one
+    if (options->first == argc || 
+            (options->stream && options->first + 1 != argc)) {
         error = 1;
     }
 
@@ -186,99 +910,494 @@ int check_args(int argc, char** argv) {
         fprintf(stderr, "%s\n", invErrMsg);
         exit(1);
     }
-    return verbose;
 }
 
-// checks if verbose mode was specified in the command lines
-// takes the verbose int variable as a parameter, is 1 if -v was specified
-// returns the position of the first file in the command line
-int check_verbose(int verbose) {
+// checks that a command line arguement is a non-negative integer
+// returns the integer, or -1 if it contains any non-digit characters
+int check_number(char* arg) {
 
-    if (verbose) {
-        return 2;
-    } else {
-        return 1;
+    if (strlen(arg) == 0 || strlen(arg) > 9) {
+        return -1;
+    }
+
+    for (int i = 0; arg[i] != '\0'; i++) {
+        if (!isdigit((int)arg[i])) {
+            return -1;
+        }
     }
+    return atoi(arg);
 }
 
 // checks for invalid files given as command line arguements
 // takes command line args as parameters
 // also takes "count" which indicates the position of the first filename
 void check_files(int argc, char** argv, int count) {
-    char* invFileMsg1 = "jobrunner: file \"";
-    char* invFileMsg2 = "\" can not be opened";
 
     for (; count < argc; count++) {
         FILE* file = fopen(argv[count], "r");
 
         if (file == NULL) {
-            fprintf(stderr, "%s%s%s\n", invFileMsg1, argv[count], invFileMsg2);
-            exit(2);
+            file_error(argv[count]);
         }
         fclose(file);
     }
 }
 
+// prints the message for a jobfile that can not be opened and exits with 
+// status 2
+void file_error(char* filename) {
+    char* invFileMsg1 = "jobrunner: file \"";
+    char* invFileMsg2 = "\" can not be opened";
+
+    fprintf(stderr, "%s%s%s\n", invFileMsg1, filename, invFileMsg2);
+    exit(2);
+}
+
 // reads the contents of the files given in the job files
 // checks for invalid files specified as standard input
-// takes filename, number of jobs and number of pipes as parameters
-// also takes an array of "Pipe" data structs as parameter
-// returns new ptr to "pipes" array in case memory is reallocated
-Pipe* read_file(char* filename, int* jobCount, InvalidJobs* invalidJobs, 
-        int* pipeCount, Pipe* pipes) {
+// takes filename, the job table, the pipe table, the invalid jobs, the 
+// trace (NULL if not tracing) and the intake
+// jobs are added up to the first sweep, whose jobs are admitted by "intake"
+// as earlier jobs are launched, as with -stream, together with the lines 
+// after it, which are only checked here
+// every line is only checked if "intake" is NULL, as it has already taken 
+// over at a sweep in an earlier jobfile
+// a pipe can not join a job before the first sweep to one after it, as the
+// pipes of the jobs before it are checked before any job runs
+// returns 1 if the intake was opened at a sweep, else returns 0
+// exits with status 3 if a line is not a valid job specification
+int read_file(char* filename, JobTable* table, PipeTable* pipes, 
+        InvalidJobs* invalidJobs, Trace* trace, Intake* intake) {
 
     FILE* file = fopen(filename, "r");
     char* line;
-    char** lineSplit;
-    int count = 1, input = 0, output = 0, timeout = 0;
+    int count = 0, sweepLine = 0, error = 0, swept = intake == NULL;
+    long start = 0, next = 0;
+    Sweep sweep;
 
-    while ((line = read_line(file)) != NULL) {
-        if (strlen(line) == 0 || isspace((int)line[0]) != 0) {
-            ;
-        } else if (line[0] != '#') {
-            lineSplit = split_by_commas(line);
-            int i;
-            for (i = 0; lineSplit[i] != NULL; i++) {
-                if (i == 1) {
-                    input = check_stdin(lineSplit);
-                } else if (i == 2) {
-                    output = check_stdout(lineSplit);
-                } else if (i == 3) {
-                    timeout = check_timeout(lineSplit);
-                }
+    while (!error && (line = read_line(file)) != NULL) {
+        count++;
+        if (!swept) {
+            start = next;
+            next = ftell(file);
+        }
+        if (strlen(line) == 0 || isspace((int)line[0]) != 0 || 
+                line[0] == '#') {
+            free(line);
+            continue;
+        }
+
+        if (!swept) {
+            swept = start_sweep(line, &sweep) != 0;
+            if (!swept) {
+                error = add_job(line, table, pipes, invalidJobs, trace) == -1;
+                continue;
             }
+            end_sweep(&sweep);
+            sweepLine = count;
+        }
+        error = check_line(line) == -1;
+    }
+    fclose(file);
+
+    if (error) {
+        invalid_line(count, filename);
+        free_alloc_mem(table, pipes, invalidJobs, NULL);
+        exit(3);
+    }
+
+    if (intake != NULL && swept) {
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            file_error(filename);
+        }
+        lseek(fd, start, SEEK_SET);
+        init_intake(intake, fd, filename, invalidJobs, 0);
+        intake->line = sweepLine;
+    }
+    return intake != NULL && swept;
+}
+
+// checks a line read after the first sweep of the jobfiles, which the 
+// intake adds to the job table later, so that an invalid line still stops 
+// jobrunner before any job runs
+// a sweep is checked by expanding every job it makes
+// returns -1 if the line is not a valid job specification, else returns 0
+int check_line(char* line) {
+    Sweep sweep;
+    int swept = start_sweep(line, &sweep);
+
+    if (swept == 0) {
+        return check_fields(line);
+    }
+
+    free(line);
+    int error = swept == -1;
+    while (!error && (line = next_sweep_line(&sweep)) != NULL) {
+        error = check_fields(line) == -1;
+    }
+    end_sweep(&sweep);
+    return error ? -1 : 0;
+}
+
+// checks the fields of a job line as add_job() does, but without adding it 
+// or opening its files, which is left until the job is admitted
+// frees the line, returns -1 if it is not a valid job specification, else 
+// returns 0
+int check_fields(char* line) {
+    char** lineSplit = split_by_commas(line);
+    int fieldCount = 0, error;
+    Job job;
+
+    while (lineSplit[fieldCount] != NULL) {
+        fieldCount++;
+    }
+
+    error = fieldCount < 3 || strlen(lineSplit[1]) == 0 || 
+            strlen(lineSplit[2]) == 0;
+    if (!error && fieldCount > 3) {
+        char* attributes = strchr(lineSplit[3], ' ');
+        if (attributes != NULL) {
+            *attributes++ = '\0';
+        }
+        error = check_timeout(lineSplit) == -1 || (attributes != NULL && 
+                check_attributes(attributes, &job) == -1);
+    }
+
+    free(lineSplit);
+    free(line);
+    return error ? -1 : 0;
+}
+
+// checks if a jobfile line is a sweep, which has "{name}=values" attributes
+// after its timeout, and if so prepares to expand it
+// the values are separated by "+" and each is either text or a range "N-N"
+// of numbers, every "{name}" in the line is replaced by a value of that 
+// variable and a job is made for each combination of values, the last
+// variable changing fastest
+// returns 1 if the line is a sweep, 0 if it is not or -1 if its variables
+// are invalid or it would make too many jobs
+int start_sweep(char* line, Sweep* sweep) {
+    char* field = line;
+
+    sweep->count = 0;
+    for (int i = 0; i < 3 && field != NULL; i++) {
+        field = strchr(field, ',');
+        field = field != NULL ? field + 1 : NULL;
+    }
+    int length = field != NULL ? (int)strcspn(field, ",") : 0;
+    if (field == NULL || memchr(field, '{', length) == NULL) {
+        return 0;
+    }
+
+    // the timeout is kept, then each attribute that is not a variable
+    int timeout = strcspn(field, " ,");
+    sweep->text = strndup(field, length);
+    sweep->line = (char*)malloc(strlen(line) + 1);
+    sweep->names = (char**)malloc(length * sizeof(char*));
+    sweep->values = (char**)malloc(length * sizeof(char*));
+    sweep->remaining = 1;
+    strncpy(sweep->line, line, field - line + timeout);
+    sweep->line[field - line + timeout] = '\0';
+
+    int error = 0;
+    for (char* attribute = strtok(sweep->text + timeout, " "); 
+            attribute != NULL; attribute = strtok(NULL, " ")) {
+        if (attribute[0] != '{' || strstr(attribute, "}=") == NULL) {
+            strcat(sweep->line, " ");
+            strcat(sweep->line, attribute);
+        } else if (add_variable(sweep, attribute) == -1) {
+            error = 1;
+        }
+    }
+    strcat(sweep->line, field + length);
+
+    if (sweep->count == 0 || error) {
+        int count = sweep->count;
+        sweep->count = 0;
+        free(sweep->line);
+        free(sweep->text);
+        free(sweep->names);
+        free(sweep->values);
+        return count == 0 && !error ? 0 : -1;
+    }
+
+    sweep->current = (char**)malloc(sweep->count * sizeof(char*));
+    sweep->sizes = (int*)malloc(sweep->count * sizeof(int));
+    sweep->positions = (int*)calloc(sweep->count, sizeof(int));
+    for (int i = 0; i < sweep->count; i++) {
+        sweep->sizes[i] = sweep_size(sweep->values[i]);
+        sweep->current[i] = (char*)malloc(strlen(sweep->values[i]) + 12);
+    }
+    return 1;
+}
+
+// adds a "{name}=values" attribute to a sweep's variables
+// returns -1 if the variable is invalid, is given twice or the sweep would
+// make more than INT_MAX jobs, else returns 0
+int add_variable(Sweep* sweep, char* attribute) {
+    char* end = strstr(attribute, "}=");
+
+    *end = '\0';
+    char* name = attribute + 1;
+    int size = sweep_size(end + 2);
+
+    if (strlen(name) == 0 || strchr(name, '{') != NULL || size <= 0 || 
+            sweep->remaining > INT_MAX / size) {
+        return -1;
+    }
+    for (int i = 0; i < sweep->count; i++) {
+        if (strcmp(sweep->names[i], name) == 0) {
+            return -1;
+        }
+    }
+
+    sweep->names[sweep->count] = name;
+    sweep->values[sweep->count++] = end + 2;
+    sweep->remaining *= size;
+    return 0;
+}
+
+// counts the values in a sweep variable's "+" separated values
+// returns the count, or -1 if a value is empty or a range is backwards
+int sweep_size(char* values) {
+    long long size = 0;
+
+    for (char* value = values; value != NULL; value = strchr(value, '+')) {
+        value += value != values;
+        int length = strcspn(value, "+"), low, high;
 
-            if (input == -2 || output == -2) {
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
-                invalidJobs->invJobs[invalidJobs->invjobCount] = *jobCount + 1;
-                (invalidJobs->invjobCount)++;
+        if (length == 0) {
+            return -1;
+        } else if (sweep_range(value, length, &low, &high)) {
+            if (high < low) {
+                return -1;
             }
-            (*jobCount)++;
+            size += high - low + 1;
+        } else {
+            size++;
+        }
+    }
+    return size > INT_MAX ? -1 : (int)size;
+}
 
-            if (i > 2) {
-                pipes = (Pipe*)realloc(pipes, (*pipeCount + 1) * sizeof(Pipe));
-                check_pipe(lineSplit, pipeCount, jobCount, pipes, invalidJobs);
-            } else {
-                input = -1;
+// checks if one of a sweep variable's values, of "length" characters, is a
+// range of numbers "N-N" and if so stores its ends in "low" and "high"
+// returns 1 if it is a range, else returns 0
+int sweep_range(char* value, int length, int* low, int* high) {
+    int digits = strspn(value, "0123456789");
+
+    if (digits == 0 || digits > 9 || value[digits] != '-' || 
+            (int)strspn(value + digits + 1, "0123456789") != 
+            length - digits - 1 || length - digits - 1 == 0 || 
+            length - digits - 1 > 9) {
+        return 0;
+    }
+    *low = atoi(value);
+    *high = atoi(value + digits + 1);
+    return 1;
+}
+
+// writes the value at "index" of a sweep variable's values to "buffer"
+void sweep_value(char* values, int index, char* buffer) {
+
+    for (char* value = values; value != NULL; value = strchr(value, '+')) {
+        value += value != values;
+        int length = strcspn(value, "+"), low, high;
+
+        if (sweep_range(value, length, &low, &high)) {
+            if (index <= high - low) {
+                sprintf(buffer, "%d", low + index);
+                return;
             }
-            free(lineSplit);
+            index -= high - low + 1;
+        } else if (index-- == 0) {
+            strncpy(buffer, value, length);
+            buffer[length] = '\0';
+            return;
         }
-        free(line);
+    }
+}
 
-        if (input == -1 || output == -1 || timeout == -1) {
-            for (int i = 0; i < (*pipeCount) - 1; i++) {
-                free(pipes[i].name);
+// expands the next job of a sweep, replacing each "{name}" in its line with
+// the current value of that variable, then moves on to the next combination
+// returns the line for add_job(), or NULL once every job has been expanded
+char* next_sweep_line(Sweep* sweep) {
+
+    if (sweep->remaining == 0) {
+        return NULL;
+    }
+    sweep->remaining--;
+
+    int length = strlen(sweep->line);
+    for (int i = 0; i < sweep->count; i++) {
+        sweep_value(sweep->values[i], sweep->positions[i], 
+                sweep->current[i]);
+        length += strlen(sweep->line) / (strlen(sweep->names[i]) + 2) * 
+                strlen(sweep->current[i]);
+    }
+
+    char* line = (char*)malloc(length + 1);
+    int used = 0;
+    for (char* text = sweep->line; *text != '\0'; ) {
+        int found = -1;
+
+        for (int i = 0; i < sweep->count && *text == '{'; i++) {
+            int size = strlen(sweep->names[i]);
+            if (strncmp(text + 1, sweep->names[i], size) == 0 && 
+                    text[size + 1] == '}') {
+                found = i;
+                break;
             }
-            free(pipes);
-            fclose(file);
-            invalid_line(count, filename);
-            exit(3);
         }
-        count++;
+
+        if (found == -1) {
+            line[used++] = *text++;
+        } else {
+            strcpy(line + used, sweep->current[found]);
+            used += strlen(sweep->current[found]);
+            text += strlen(sweep->names[found]) + 2;
+        }
     }
-    fclose(file);
-    return pipes;
+    line[used] = '\0';
+
+    for (int i = sweep->count - 1; i >= 0; i--) {
+        if (++sweep->positions[i] < sweep->sizes[i]) {
+            break;
+        }
+        sweep->positions[i] = 0;
+    }
+    return line;
+}
+
+// frees a sweep, whether or not every job has been expanded
+void end_sweep(Sweep* sweep) {
+
+    if (sweep->count == 0) {
+        return;
+    }
+    for (int i = 0; i < sweep->count; i++) {
+        free(sweep->current[i]);
+    }
+    free(sweep->line);
+    free(sweep->text);
+    free(sweep->names);
+    free(sweep->values);
+    free(sweep->current);
+    free(sweep->sizes);
+    free(sweep->positions);
+    sweep->count = 0;
+}
+
+// splits one line of a jobfile and adds it to the job table, in a slot left
+// by a job of a sweep if there is one or else at the end
+// the job table takes ownership of the line, whose fields are kept in place
+// the time the job was parsed is traced if "trace" is not NULL
+// returns -1 if the line is not a valid job specification, else returns the
+// job's index
+int add_job(char* line, JobTable* table, PipeTable* pipes, 
+        InvalidJobs* invalidJobs, Trace* trace) {
+
+    char** lineSplit = split_by_commas(line);
+    int fieldCount = 0, input = 0, output = 0, timeout = 0;
+    char* attributes = NULL;
+
+    while (lineSplit[fieldCount] != NULL) {
+        fieldCount++;
+    }
+
+    if (fieldCount > 1) {
+        input = check_stdin(lineSplit);
+    }
+    if (fieldCount > 2) {
+        output = check_stdout(lineSplit);
+    }
+    if (fieldCount > 3) {
+        // attributes follow the timeout, separated from it by a space
+        attributes = strchr(lineSplit[3], ' ');
+        if (attributes != NULL) {
+            *attributes++ = '\0';
+        }
+        timeout = check_timeout(lineSplit);
+    }
+
+    if (fieldCount < 3 || input == -1 || output == -1 || timeout == -1) {
+        free(lineSplit);
+        free(line);
+        return -1;
+    }
+
+    if (table->spareCount == 0 && table->count == table->size) {
+        table->size = table->size ? 2 * table->size : 16;
+        table->jobs = (Job*)realloc(table->jobs, table->size * sizeof(Job));
+        table->spares = (int*)realloc(table->spares, 
+                table->size * sizeof(int));
+    }
+    if (trace != NULL && table->count == trace->size) {
+        grow_trace(trace, table->count + 1);
+    }
+
+    int index = table->spareCount > 0 ? 
+            table->spares[table->spareCount - 1] : table->count;
+    Job* job = &table->jobs[index];
+    job->line = line;
+    job->input = lineSplit[1];
+    job->output = lineSplit[2];
+    job->timeoutText = fieldCount > 3 ? lineSplit[3] : NULL;
+    job->timeout = timeout;
+    job->after = NULL;
+    job->inPipe = -1;
+    job->outPipe = -1;
+    job->nextReader = -1;
+    job->fanFd[0] = -1;
+    job->fanFd[1] = -1;
+    job->number = table->numbers + 1;
+    job->result = -1;
+    job->cpus = NULL;
+    job->nice = NICE_UNSET;
+    job->ioprio = -1;
+    job->cpu = -1;
+    job->pipeSize = 0;
+    job->memLimit = 0;
+    job->fileLimit = 0;
+    job->cpuLimit = 0;
+    job->cpuRate = 0;
+    job->cgroupFd = -1;
+    job->hash = 0;
+    job->pid = -1;
+    job->start = 0;
+    job->usage.wall = -1;
+    job->sweep = 0;
+
+    if (attributes != NULL && check_attributes(attributes, job) == -1) {
+        free(lineSplit);
+        free(line);
+        return -1;
+    }
+
+    // the arguments are moved down to follow the command, so the fields 
+    // array is reused as the NULL terminated argv for execvp()
+    job->argv = lineSplit;
+    for (int i = 1; i + 3 <= fieldCount && fieldCount > 3; i++) {
+        lineSplit[i] = lineSplit[i + 3];
+    }
+    if (fieldCount <= 3) {
+        lineSplit[1] = NULL;
+    }
+
+    if (input == -2 || output == -2) {
+        add_invalid_job(invalidJobs, job->number);
+    }
+
+    if (index == table->count) {
+        table->count++;
+    } else {
+        table->spareCount--;
+    }
+    table->numbers++;
+    check_pipe(table, index, pipes, invalidJobs);
+    trace_event(trace, index, TRACE_PARSED);
+    return index;
 }
 
 // checks files specified as standard input
@@ -337,231 +1456,370 @@ int check_stdout(char** line) {
 
 // checks for timeout specified in the job files
 // takes the specified timeout value as a parameter in string form
-// returns 0 is no timeout value was specified, else returns timeout value
+// the timeout is in seconds, or in milliseconds if it ends with "ms"
+// returns 0 is no timeout value was specified, else returns timeout in ms
 // returns -1 if invalid characters (non-integers) are specified as timeout
 int check_timeout(char** line) {
 
     for (int i = 0; line[i] != NULL; i++) {
         if (i == 3) {
+            int len = strlen(line[i]), scale = 1000;
+
+            if (len > 2 && strcmp(line[i] + len - 2, "ms") == 0) {
+                len -= 2;
+                scale = 1;
+            }
 
-            for (int j = 0; line[i][j] != '\0'; j++) {
+            long long time = 0;
+            for (int j = 0; j < len; j++) {
                 if (!isdigit((int)line[i][j])) {
                     return -1;
                 }
+                if (time < INT_MAX) {
+                    time = time * 10 + (line[i][j] - '0');
+                }
             }
 
-            return atoi(line[i]);
+            time *= scale;
+            return time > INT_MAX ? INT_MAX : (int)time;
         }
     }
     return 0;
 }
 
-// checks for pipes specified in the job files
-// takes the current line being read from as a parameter
-// takes the number of pipes and number of jobs as parameters
-// takes the an array of the "Pipe" data struct as a parameter
-void check_pipe(char** line, int* pipeCount, int* jobCount, Pipe* pipes, 
-        InvalidJobs* invalidJobs) {
-
-    int input = -1, output = -1, existingPipe1 = 0, existingPipe2 = 0;
-
-    check_pipe_input(line, &input, &existingPipe1, pipes, invalidJobs, 
-            pipeCount, jobCount);
-
-    check_pipe_output(line, &output, &existingPipe2, pipes, invalidJobs,
-            pipeCount, jobCount);
+// checks the attributes given after the timeout, separated by spaces
+// "after=N+N..." makes the job wait until jobs N... have exited successfully
+// "cpus=N+N-N..." restricts the job to those cpus, "nice=N" sets its nice 
+// value and "ioprio=class/level" its I/O priority
+// "pipesize=N" sets the buffer size of the pipe the job writes to
+// "mem=N", "fsize=N" and "cpu=N" limit the job's memory and file sizes in 
+// bytes and its cpu time in seconds, "cpurate=N" limits it to N percent of
+// a cpu with -cgroup
+// returns -1 if an attribute is unknown or invalid, else returns 0
+int check_attributes(char* text, Job* job) {
+
+    for (char* attribute = strtok(text, " "); attribute != NULL; 
+            attribute = strtok(NULL, " ")) {
+
+        if (strncmp(attribute, "after=", 6) == 0 && 
+                check_after(attribute + 6) == 0) {
+            job->after = attribute + 6;
+        } else if (strncmp(attribute, "cpus=", 5) == 0 && 
+                check_cpus(attribute + 5, NULL) == 0) {
+            job->cpus = attribute + 5;
+        } else if (strncmp(attribute, "nice=", 5) == 0 && 
+                check_nice(attribute + 5) != NICE_UNSET) {
+            job->nice = check_nice(attribute + 5);
+        } else if (strncmp(attribute, "ioprio=", 7) == 0 && 
+                check_ioprio(attribute + 7) != -1) {
+            job->ioprio = check_ioprio(attribute + 7);
+        } else if (strncmp(attribute, "pipesize=", 9) == 0 && 
+                check_size(attribute + 9) > 0 && 
+                check_size(attribute + 9) <= INT_MAX) {
+            job->pipeSize = (int)check_size(attribute + 9);
+        } else if (strncmp(attribute, "mem=", 4) == 0 && 
+                check_size(attribute + 4) > 0) {
+            job->memLimit = check_size(attribute + 4);
+        } else if (strncmp(attribute, "fsize=", 6) == 0 && 
+                check_size(attribute + 6) > 0) {
+            job->fileLimit = check_size(attribute + 6);
+        } else if (strncmp(attribute, "cpu=", 4) == 0 && 
+                check_number(attribute + 4) > 0) {
+            job->cpuLimit = check_number(attribute + 4);
+        } else if (strncmp(attribute, "cpurate=", 8) == 0 && 
+                check_number(attribute + 8) > 0 && 
+                check_number(attribute + 8) <= 100000) {
+            job->cpuRate = check_number(attribute + 8);
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    if (line[1][0] == '@') {
+// checks a list of job numbers separated by '+'
+// returns -1 if any job number is not a positive integer, else returns 0
+int check_after(char* list) {
+    int digits = 0;
 
-        if (output != -1) {
-            pipes[*(pipeCount) - 1].error = 1;
-        } 
+    for (int i = 0; ; i++) {
+        if (isdigit((int)list[i])) {
+            digits++;
+        } else if ((list[i] == '+' || list[i] == '\0') && digits > 0 && 
+                digits <= 9 && atoi(list + i - digits) > 0) {
 
-        if (!existingPipe2) {
-            int len = strlen(line[1]) + 1;
-            pipes[*(pipeCount) - 1].name = (char*)malloc(len * sizeof(Pipe));
-            strcpy(pipes[*(pipeCount) - 1].name, line[1]);
-            pipes[*(pipeCount) - 1].output = (*jobCount);
-            pipes[*(pipeCount) - 1].input = -1;
-            pipes[*(pipeCount) - 1].error = 0;
-            pipes[*(pipeCount) - 1].number = (*pipeCount);
-            (*pipeCount)++;
+            if (list[i] == '\0') {
+                return 0;
+            }
+            digits = 0;
+        } else {
+            return -1;
         }
     }
+}
 
-    if (line[2][0] == '@') {
+// checks a list of cpus or ranges of cpus such as "0-3" separated by '+'
+// each cpu is added to "set" unless it is NULL
+// returns -1 if the list is invalid or a cpu is not below CPU_SETSIZE
+int check_cpus(char* list, cpu_set_t* set) {
 
-        if (input != -1) {
-            pipes[*(pipeCount) - 1].error = 1;
-        } 
+    while (1) {
+        if (!isdigit((int)*list)) {
+            return -1;
+        }
 
-        if (!existingPipe1) {
-            int len = strlen(line[2]) + 1;
-            pipes[*(pipeCount) - 1].name = (char*)malloc(len * sizeof(Pipe));
-            strcpy(pipes[*(pipeCount) - 1].name, line[2]);
+        long first = strtol(list, &list, 10), last = first;
+        if (*list == '-') {
+            list++;
+            if (!isdigit((int)*list)) {
+                return -1;
+            }
+            last = strtol(list, &list, 10);
+        }
 
-            pipes[*(pipeCount) - 1].input = (*jobCount);
-            pipes[*(pipeCount) - 1].output = -1;
-            pipes[*(pipeCount) - 1].error = 0;
-            pipes[*(pipeCount) - 1].number = (*pipeCount);
+        if (last < first || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; set != NULL && cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
 
-            (*pipeCount)++;
+        if (*list == '\0') {
+            return 0;
+        } else if (*list++ != '+') {
+            return -1;
         }
     }
 }
 
-// checks that specified pipes have only one input
-// takes the current line, input status, existing pipe status as parameters
-// also takes the pipes and invalid jobs data structure, pipes and jobs count
-void check_pipe_input(char** line, int* input, int* existingPipe1, 
-        Pipe* pipes, InvalidJobs* invalidJobs, int* pipeCount, int* jobCount) {
+// checks a nice value, an integer from -20 to 19
+// returns the nice value, or NICE_UNSET if it is invalid
+int check_nice(char* text) {
+    int negative = text[0] == '-';
+    int value = check_number(text + negative);
 
-    int in0, in1;
-    for (int i = 0; i < (*pipeCount) - 1; i++) {
+    if (value == -1 || value > 20 || (!negative && value == 20)) {
+        return NICE_UNSET;
+    }
+    return negative ? -value : value;
+}
 
-        in0 = 0;
-        in1 = 0;
-        if (strcmp(pipes[i].name, line[2]) == 0) {
-            *input = pipes[i].input;
-            (*existingPipe1)++;
-            pipes[i].input = (*jobCount);
+// checks an I/O priority, "idle" or "be" or "rt" followed by an optional 
+// level from 0 (highest) to 7, such as "be/7", the level is 4 if not given
+// returns the priority for ioprio_set(), or -1 if it is invalid
+int check_ioprio(char* text) {
+    int class, level = 4;
+
+    if (strcmp(text, "idle") == 0) {
+        return IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    } else if (strncmp(text, "be", 2) == 0) {
+        class = IOPRIO_CLASS_BE;
+    } else if (strncmp(text, "rt", 2) == 0) {
+        class = IOPRIO_CLASS_RT;
+    } else {
+        return -1;
+    }
 
-            for (int j = 0; j < invalidJobs->invjobCount; j++) {
+    if (text[2] == '/') {
+        level = check_number(text + 3);
+    } else if (text[2] != '\0') {
+        return -1;
+    }
 
-                if (pipes[i].input == invalidJobs->invJobs[j]) {
-                    in0 = 1;
-                }
+    if (level < 0 || level > 7) {
+        return -1;
+    }
+    return class << IOPRIO_CLASS_SHIFT | level;
+}
 
-                if (*input == invalidJobs->invJobs[j]) {
-                    in1 = 1;
-                }
-            }
+// checks a size in bytes, which may end in 'k', 'm' or 'g' for KB, MB or GB
+// returns the size, or -1 if it is invalid
+long long check_size(char* text) {
+    int len = strlen(text);
+    long long scale = 1;
+
+    if (len > 1 && strchr("kK", text[len - 1]) != NULL) {
+        scale = 1024;
+    } else if (len > 1 && strchr("mM", text[len - 1]) != NULL) {
+        scale = 1024 * 1024;
+    } else if (len > 1 && strchr("gG", text[len - 1]) != NULL) {
+        scale = 1024 * 1024 * 1024;
+    }
 
-            if (!in0 && *input != -1) {
-                pipes[i].error = 1;
+    char digits[10];
+    len -= scale != 1;
+    if (len < 1 || len >= (int)sizeof(digits)) {
+        return -1;
+    }
+    memcpy(digits, text, len);
+    digits[len] = '\0';
 
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
+    int number = check_number(digits);
+    return number == -1 ? -1 : number * scale;
+}
 
-                int pipesInput = pipes[i].input;
-                invalidJobs->invJobs[invalidJobs->invjobCount] = pipesInput;
-                (invalidJobs->invjobCount)++;
-            }
-            if (!in1 && *input != -1) {
-                pipes[i].error = 1;
+// checks for pipes specified as the stdin or stdout of a job
+// takes the job table and the index of the job to check as parameters
+// a pipe may have several readers, but a pipe with more than one writer or
+// which a job both reads and writes is marked as an error and every job 
+// using it is made invalid by check_invalid_pipe(), the first writer is kept
+void check_pipe(JobTable* table, int index, PipeTable* pipes, 
+        InvalidJobs* invalidJobs) {
 
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
+    Job* job = &table->jobs[index];
 
-                invalidJobs->invJobs[invalidJobs->invjobCount] = *input;
-                (invalidJobs->invjobCount)++;
-            }
+    if (job->input[0] == '@') {
+        job->inPipe = find_pipe(pipes, job->input);
+        Pipe* pipe = &pipes->pipes[job->inPipe];
+
+        if (pipe->writer == index) {
+            pipe->error = 1;
         }
+        job->nextReader = pipe->reader;
+        pipe->reader = index;
+        pipe->readerCount++;
     }
-}
 
-// checks that specified pipes have only one output
-// takes the current line, output status, existing pipe status as parameters
-// also takes the pipes and invalid jobs data structure, pipes and jobs count
-void check_pipe_output(char** line, int* output, int* existingPipe2, 
-        Pipe* pipes, InvalidJobs* invalidJobs, int* pipeCount, int* jobCount) {
-    int out0, out1;
+    if (job->output[0] == '@') {
+        job->outPipe = find_pipe(pipes, job->output);
+        Pipe* pipe = &pipes->pipes[job->outPipe];
 
-    for (int i = 0; i < (*pipeCount) - 1; i++) {
-        out0 = 0;
-        out1 = 0;
-        if (strcmp(pipes[i].name, line[1]) == 0) {
-            *output = pipes[i].output;
-            (*existingPipe2)++;
-            pipes[i].output = (*jobCount);
+        if (pipe->writer != -1 || pipe->reader == index) {
+            pipe->error = 1;
+        }
+        if (pipe->writer == -1) {
+            pipe->writer = index;
+        }
+    }
+}
 
-            for (int j = 0; j < invalidJobs->invjobCount; j++) {
+// finds a pipe in the pipe table by its name, including the '@'
+// adds a new pipe with no reader or writer if the name is not found
+// returns the index of the pipe in the pipe table
+int find_pipe(PipeTable* pipes, char* name) {
 
-                if (pipes[i].output == invalidJobs->invJobs[j]) {
-                    out0 = 1;
-                }
+    if (2 * (pipes->count + 1) > pipes->bucketCount) {
+        grow_pipe_buckets(pipes);
+    }
 
-                if (*output == invalidJobs->invJobs[j]) {
-                    out1 = 1;
-                }
-            }
+    int slot = hash_name(name) & (pipes->bucketCount - 1);
+    while (pipes->buckets[slot] != -1) {
+        if (strcmp(pipes->pipes[pipes->buckets[slot]].name, name) == 0) {
+            return pipes->buckets[slot];
+        }
+        slot = (slot + 1) & (pipes->bucketCount - 1);
+    }
+    pipes->buckets[slot] = pipes->count;
 
-            if (!out0 && *output != -1) {
-                pipes[i].error = 1;
+    if (pipes->count == pipes->size) {
+        pipes->size = pipes->size ? 2 * pipes->size : 16;
+        pipes->pipes = (Pipe*)realloc(pipes->pipes, 
+                pipes->size * sizeof(Pipe));
+    }
 
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
+    Pipe* pipe = &pipes->pipes[pipes->count];
+    pipe->name = name;
+    pipe->writer = -1;
+    pipe->reader = -1;
+    pipe->readerCount = 0;
+    pipe->error = 0;
+    pipe->size = 0;
+    pipe->fd[0] = -1;
+    pipe->fd[1] = -1;
+    return pipes->count++;
+}
 
-                int pipesOutput = pipes[i].output;
-                invalidJobs->invJobs[invalidJobs->invjobCount] = pipesOutput;
-                (invalidJobs->invjobCount)++;
-            }
+// gets the FNV-1a hash of a pipe name
+unsigned int hash_name(char* name) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; name[i] != '\0'; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-            if (!out1 && *output != -1) {
-                pipes[i].error = 1;
+// doubles the number of buckets in the pipe table's hash table
+// every existing pipe is inserted again into the new buckets
+void grow_pipe_buckets(PipeTable* pipes) {
+    pipes->bucketCount = pipes->bucketCount ? 2 * pipes->bucketCount : 64;
+    pipes->buckets = (int*)realloc(pipes->buckets, 
+            pipes->bucketCount * sizeof(int));
 
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
+    for (int i = 0; i < pipes->bucketCount; i++) {
+        pipes->buckets[i] = -1;
+    }
 
-                invalidJobs->invJobs[invalidJobs->invjobCount] = *output;
-                (invalidJobs->invjobCount)++;
-            }
+    for (int i = 0; i < pipes->count; i++) {
+        int slot = hash_name(pipes->pipes[i].name) & 
+                (pipes->bucketCount - 1);
+        while (pipes->buckets[slot] != -1) {
+            slot = (slot + 1) & (pipes->bucketCount - 1);
         }
+        pipes->buckets[slot] = i;
     }
 }
 
-// checks for invalid pipes that are missing a read or write end
-// takes an array of the "Pipe" data struct and num of pipes as parameters
-void check_invalid_pipe(Pipe* pipes, int pipeCount, int* validPipes, 
-        int* jobCount, InvalidJobs* invalidJobs) {
-
-    char* invPipeMsg1 = "Invalid pipe usage \"";
-    char* invPipeMsg2 = "\"";
-    int in, out;
+// adds a job number to the invalid jobs if it is not already there
+// the bitset grows to fit the job number if needed
+void add_invalid_job(InvalidJobs* invalidJobs, int number) {
 
-    for (int i = 0; i < pipeCount - 1; i++) {
-        in = 0;
-        out = 0;
-        if (pipes[i].input == -1 || pipes[i].output == -1 ||
-                pipes[i].error == 1) {
+    if (is_invalid_job(invalidJobs, number)) {
+        return;
+    }
 
-            for (int j = 0; j < invalidJobs->invjobCount; j++) {
+    if (number / WORD_BITS >= invalidJobs->size) {
+        int size = invalidJobs->size ? invalidJobs->size : 1;
+        while (number / WORD_BITS >= size) {
+            size *= 2;
+        }
 
-                if (pipes[i].input == invalidJobs->invJobs[j]) {
-                    in = 1;
-                }
+        invalidJobs->invJobs = (unsigned long*)realloc(invalidJobs->invJobs, 
+                size * sizeof(unsigned long));
+        memset(invalidJobs->invJobs + invalidJobs->size, 0, 
+                (size - invalidJobs->size) * sizeof(unsigned long));
+        invalidJobs->size = size;
+    }
 
-                if (pipes[i].output == invalidJobs->invJobs[j]) {
-                    out = 1;
-                }
-            }
+    invalidJobs->invJobs[number / WORD_BITS] |= 1UL << (number % WORD_BITS);
+    (invalidJobs->invjobCount)++;
+}
 
-            int input = pipes[i].input;
-            int output = pipes[i].output;
-            if (!in && input != -1) {
+// checks if a job number is one of the invalid jobs
+// returns 1 if the job is invalid, else returns 0
+int is_invalid_job(InvalidJobs* invalidJobs, int number) {
 
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
+    if (number / WORD_BITS >= invalidJobs->size) {
+        return 0;
+    }
+    return (invalidJobs->invJobs[number / WORD_BITS] >> 
+            (number % WORD_BITS)) & 1;
+}
 
-                invalidJobs->invJobs[invalidJobs->invjobCount] = input;
-                (invalidJobs->invjobCount)++;
-            }
-            if (!out && output != -1) {
+// checks for invalid pipes that are missing a read or write end
+// prints a message for each invalid pipe and makes every job using it invalid
+void check_invalid_pipe(JobTable* table, PipeTable* pipes, 
+        InvalidJobs* invalidJobs) {
 
-                invalidJobs->invJobs = (int*)realloc(invalidJobs->invJobs, 
-                        (invalidJobs->invjobCount + 1) * sizeof(int));
+    char* invPipeMsg1 = "Invalid pipe usage \"";
+    char* invPipeMsg2 = "\"";
 
-                invalidJobs->invJobs[invalidJobs->invjobCount] = output;
-                (invalidJobs->invjobCount)++;
-            }
+    for (int i = 0; i < pipes->count; i++) {
+        Pipe* pipe = &pipes->pipes[i];
 
-            fprintf(stderr, "%s%s%s\n", invPipeMsg1, pipes[i].name + 1, 
+        if (pipe->writer == -1 || pipe->reader == -1 || pipe->error) {
+            fprintf(stderr, "%s%s%s\n", invPipeMsg1, pipe->name + 1, 
                     invPipeMsg2);
+            pipe->error = 1;
+        }
+    }
 
-            pipes[i].error = 1;
+    for (int i = 0; i < table->count; i++) {
+        Job* job = &table->jobs[i];
 
-        } else {
-            (*validPipes)++;
+        if ((job->inPipe != -1 && pipes->pipes[job->inPipe].error) ||
+                (job->outPipe != -1 && pipes->pipes[job->outPipe].error)) {
+            add_invalid_job(invalidJobs, job->number);
         }
     }
 }
@@ -595,444 +1853,3255 @@ void invalid_write(char* filename) {
 }
 
 // prints jobfile specs to stderr if -v is specified on the command line
-// takes the filename and the InvalidJobs data struct as parameters
-// also takes the timeouts array as a parameter
-void verbose_mode(char* filename, InvalidJobs* invalidJobs, Timeouts* timeouts,
-        int verbose, int* timeCount, int* invalidCount) {
+// takes the job table and the InvalidJobs data struct as parameters
+// each valid job is printed with its fields separated by ':'
+void verbose_mode(JobTable* table, InvalidJobs* invalidJobs, int verbose) {
 
-    FILE* file = fopen(filename, "r");
-    char* line;
-    char** lineSplit;
-    int pass;
+    if (!verbose) {
+        return;
+    }
 
-    while ((line = read_line(file)) != NULL) {
-        pass = 0;
+    for (int i = 0; i < table->count; i++) {
+        Job* job = &table->jobs[i];
 
-        if (strlen(line) == 0 || isspace((int)line[0]) != 0) {
-            ;
-        } else if (line[0] != '#') {
+        if (!is_invalid_job(invalidJobs, job->number)) {
+            verbose_job(job);
+        }
+    }
+    fflush(stderr);
+}
+
+// prints the fields of one job to stderr separated by ':'
+void verbose_job(Job* job) {
+
+    char* timeout = job->timeoutText;
+    if (timeout == NULL || strlen(timeout) == 0) {
+        timeout = "0";
+    }
+
+    fprintf(stderr, "%d:%s:%s:%s:%s", job->number, job->argv[0], 
+            job->input, job->output, timeout);
+    for (int j = 1; job->argv[j] != NULL; j++) {
+        fprintf(stderr, ":%s", job->argv[j]);
+    }
+    fprintf(stderr, "\n");
+}
+
+// checks for no jobs specified by the job files
+// takes the number of jobs named "count" as a parameter
+// exits with status 4 there are no jobs
+void check_jobs(int count) {
+    char* noJobsMsg = "jobrunner: no runnable jobs";
+
+    if (!(count > 0)) {
+        fprintf(stderr, "%s\n", noJobsMsg);
+        exit(4);
+    }
+}
+
+// counts the valid jobs in the job table and queues the units that do not
+// depend on any other job
+// takes the most jobs that may run at once, returns the number of valid jobs
+int setup_processes(JobTable* table, InvalidJobs* invalidJobs, 
+        Scheduler* scheduler, int limit) {
+
+    int execCount = 0;
+    for (int i = 0; i < table->count; i++) {
+        if (!is_invalid_job(invalidJobs, table->jobs[i].number)) {
+            execCount++;
+        }
+    }
+
+    scheduler->limit = limit;
+    scheduler->ready = (int*)malloc(scheduler->unitCount * sizeof(int));
+    scheduler->skipped = (int*)malloc(scheduler->unitCount * sizeof(int));
+    scheduler->readyHead = 0;
+    scheduler->readyTail = 0;
+
+    for (int i = 0; i < scheduler->unitCount; i++) {
+        if (scheduler->waiting[i] == 0) {
+            scheduler->ready[scheduler->readyTail++] = i;
+        }
+    }
+    return execCount;
+}
+
+// groups the valid jobs into units of jobs connected by pipes
+// uses a union-find over the jobs at both ends of every valid pipe, then
+// lists the units in the order of their first job
+void find_units(JobTable* table, PipeTable* pipes, InvalidJobs* invalidJobs, 
+        Scheduler* scheduler) {
+
+    int* parents = (int*)malloc(table->count * sizeof(int));
+    int* lasts = (int*)malloc(table->count * sizeof(int));
+    int* roots = (int*)malloc(table->count * sizeof(int));
+
+    for (int i = 0; i < table->count; i++) {
+        parents[i] = i;
+        roots[i] = -1;
+    }
+
+    for (int i = 0; i < table->count; i++) {
+        int inPipe = table->jobs[i].inPipe;
+
+        if (inPipe != -1 && !pipes->pipes[inPipe].error) {
+            parents[find_root(parents, pipes->pipes[inPipe].writer)] = 
+                    find_root(parents, i);
+        }
+    }
+
+    scheduler->firsts = (int*)malloc(table->count * sizeof(int));
+    scheduler->sizes = (int*)malloc(table->count * sizeof(int));
+    scheduler->nextJobs = (int*)malloc(table->count * sizeof(int));
+    scheduler->unitOf = (int*)malloc(table->count * sizeof(int));
+    scheduler->incoming = (int*)calloc(table->count, sizeof(int));
+    scheduler->spareUnits = (int*)malloc(table->count * sizeof(int));
+    scheduler->spareUnitCount = 0;
+    scheduler->unitCount = 0;
+
+    for (int i = 0; i < table->count; i++) {
+        scheduler->nextJobs[i] = -1;
+        scheduler->unitOf[i] = -1;
+
+        if (is_invalid_job(invalidJobs, table->jobs[i].number)) {
+            continue;
+        }
+
+        int root = find_root(parents, i);
+        int unit = roots[root];
+
+        if (unit == -1) {
+            unit = scheduler->unitCount++;
+            roots[root] = unit;
+            scheduler->firsts[unit] = i;
+            scheduler->sizes[unit] = 0;
+        } else {
+            scheduler->nextJobs[lasts[unit]] = i;
+        }
+        lasts[unit] = i;
+        scheduler->sizes[unit]++;
+        scheduler->unitOf[i] = unit;
+    }
+
+    free(parents);
+    free(lasts);
+    free(roots);
+}
+
+// finds the root of a job in the union-find, halving the path on the way
+int find_root(int* parents, int job) {
+    while (parents[job] != job) {
+        parents[job] = parents[parents[job]];
+        job = parents[job];
+    }
+    return job;
+}
+
+// builds the dependency graph between units and checks it for cycles
+// the units are sorted with Kahn's algorithm, any unit left over is in a 
+// cycle, depends on a missing or invalid job or on a job in its own unit, or
+// depends on such a unit, so each of its jobs is made invalid
+void check_dependencies(JobTable* table, InvalidJobs* invalidJobs, 
+        Scheduler* scheduler) {
+
+    int unitCount = scheduler->unitCount;
+    int* indegrees = (int*)calloc(unitCount + 1, sizeof(int));
+    int* broken = (int*)calloc(unitCount + 1, sizeof(int));
+    int* order = (int*)malloc((unitCount + 1) * sizeof(int));
+
+    add_dependencies(table, scheduler, indegrees, broken);
+    scheduler->waiting = (int*)malloc((unitCount + 1) * sizeof(int));
+    memcpy(scheduler->waiting, indegrees, unitCount * sizeof(int));
+
+    int head = 0, tail = 0;
+    for (int i = 0; i < unitCount; i++) {
+        if (indegrees[i] == 0 && !broken[i]) {
+            order[tail++] = i;
+        }
+    }
+
+    while (head < tail) {
+        int unit = order[head++];
+
+        for (int i = scheduler->firsts[unit]; i != -1; 
+                i = scheduler->nextJobs[i]) {
+            for (int j = scheduler->depHeads[i]; j != -1; 
+                    j = scheduler->depNexts[j]) {
+                int next = scheduler->depUnits[j];
+
+                if (--indegrees[next] == 0 && !broken[next]) {
+                    order[tail++] = next;
+                }
+            }
+        }
+    }
+
+    // units which were sorted are kept, the rest are removed
+    for (int i = 0; i < unitCount; i++) {
+        broken[i] = 1;
+    }
+    for (int i = 0; i < tail; i++) {
+        broken[order[i]] = 0;
+    }
+    remove_units(table, invalidJobs, scheduler, broken);
+
+    free(indegrees);
+    free(broken);
+    free(order);
+}
+
+// adds an edge from each job to every unit which depends on it
+// counts the dependencies of each unit in "indegrees" and marks units which
+// depend on a missing or invalid job or on their own unit as "broken"
+void add_dependencies(JobTable* table, Scheduler* scheduler, int* indegrees, 
+        int* broken) {
+
+    scheduler->depHeads = (int*)malloc(table->count * sizeof(int));
+    scheduler->depTails = (int*)malloc(table->count * sizeof(int));
+    scheduler->depNexts = NULL;
+    scheduler->depUnits = NULL;
+    scheduler->edgeCount = 0;
+    scheduler->edgeSize = 0;
+    scheduler->freeEdge = -1;
+
+    for (int i = 0; i < table->count; i++) {
+        scheduler->depHeads[i] = -1;
+    }
+
+    for (int i = 0; i < table->count; i++) {
+        int unit = scheduler->unitOf[i];
+        char* list = table->jobs[i].after;
+
+        if (unit == -1 || list == NULL) {
+            continue;
+        }
+
+        int number;
+        while ((number = next_dependency(&list)) != 0) {
+            int dep = number - 1;
+
+            if (dep >= table->count || scheduler->unitOf[dep] == -1 ||
+                    scheduler->unitOf[dep] == unit) {
+                broken[unit] = 1;
+            } else {
+                add_edge(scheduler, dep, unit);
+                indegrees[unit]++;
+            }
+        }
+    }
+}
+
+// adds an edge from a job to a unit which depends on it
+// the edge goes at the end of the job's list, so units are queued in the 
+// order they were added when the job exits
+// an edge freed by free_edges() is reused before the edges grow
+void add_edge(Scheduler* scheduler, int job, int unit) {
+    int edge = scheduler->freeEdge;
+
+    if (edge != -1) {
+        scheduler->freeEdge = scheduler->depNexts[edge];
+    } else {
+        if (scheduler->edgeCount == scheduler->edgeSize) {
+            scheduler->edgeSize = scheduler->edgeSize ? 
+                    2 * scheduler->edgeSize : 16;
+            scheduler->depNexts = (int*)realloc(scheduler->depNexts, 
+                    scheduler->edgeSize * sizeof(int));
+            scheduler->depUnits = (int*)realloc(scheduler->depUnits, 
+                    scheduler->edgeSize * sizeof(int));
+        }
+        edge = scheduler->edgeCount++;
+    }
+
+    scheduler->depUnits[edge] = unit;
+    scheduler->depNexts[edge] = -1;
+    scheduler->incoming[unit]++;
+
+    if (scheduler->depHeads[job] == -1) {
+        scheduler->depHeads[job] = edge;
+    } else {
+        scheduler->depNexts[scheduler->depTails[job]] = edge;
+    }
+    scheduler->depTails[job] = edge;
+}
+
+// frees the edges from a job which has exited or been skipped once they 
+// have been followed
+// a unit whose jobs have left the job table is spared once no edge leads to
+// it, as a skipped unit may still be named by jobs that have not exited
+void free_edges(Scheduler* scheduler, int job) {
+    int head = scheduler->depHeads[job];
+
+    if (head == -1) {
+        return;
+    }
+
+    for (int i = head; i != -1; i = scheduler->depNexts[i]) {
+        int unit = scheduler->depUnits[i];
+
+        if (unit != -1 && --scheduler->incoming[unit] == 0 && 
+                scheduler->firsts[unit] == -1) {
+            scheduler->spareUnits[scheduler->spareUnitCount++] = unit;
+        }
+    }
+    scheduler->depNexts[scheduler->depTails[job]] = scheduler->freeEdge;
+    scheduler->freeEdge = head;
+    scheduler->depHeads[job] = -1;
+}
+
+// reads the next job number from a list of job numbers separated by '+'
+// returns the job number, or 0 when the end of the list is reached
+int next_dependency(char** list) {
+
+    if (**list == '\0') {
+        return 0;
+    }
+
+    int number = (int)strtol(*list, list, 10);
+    if (**list == '+') {
+        (*list)++;
+    }
+    return number;
+}
+
+// removes every unit marked in "removed" from the scheduler
+// prints a message for each job of a removed unit and makes it invalid, the
+// remaining units keep their order and are renumbered
+void remove_units(JobTable* table, InvalidJobs* invalidJobs, 
+        Scheduler* scheduler, int* removed) {
+
+    char* invDepMsg = "Invalid dependency for job";
+    int* newUnits = removed;
+    int count = 0;
+
+    for (int i = 0; i < scheduler->unitCount; i++) {
+        if (removed[i]) {
+            for (int j = scheduler->firsts[i]; j != -1; 
+                    j = scheduler->nextJobs[j]) {
+                fprintf(stderr, "%s %d\n", invDepMsg, table->jobs[j].number);
+                add_invalid_job(invalidJobs, table->jobs[j].number);
+            }
+            newUnits[i] = -1;
+            continue;
+        }
+
+        scheduler->firsts[count] = scheduler->firsts[i];
+        scheduler->sizes[count] = scheduler->sizes[i];
+        scheduler->waiting[count] = scheduler->waiting[i];
+        scheduler->incoming[count] = scheduler->incoming[i];
+        newUnits[i] = count++;
+    }
+    scheduler->unitCount = count;
+
+    for (int i = 0; i < table->count; i++) {
+        if (scheduler->unitOf[i] != -1) {
+            scheduler->unitOf[i] = newUnits[scheduler->unitOf[i]];
+        }
+    }
+    for (int i = 0; i < scheduler->edgeCount; i++) {
+        scheduler->depUnits[i] = newUnits[scheduler->depUnits[i]];
+    }
+}
+
+// launches units in order while they fit within the job limit
+// a unit larger than the limit is launched alone once nothing is running,
+// no more units are launched after a sighup or while -throttle finds the 
+// host under pressure
+void launch_units(Runner* runner, JobTable* table, PipeTable* pipes) {
+    Scheduler* scheduler = runner->scheduler;
+
+    while (scheduler->readyHead < scheduler->readyTail && !sighup) {
+        int unit = scheduler->ready[scheduler->readyHead];
+
+        if (scheduler->limit && runner->states.running > 0 && 
+                runner->states.running + scheduler->sizes[unit] > 
+                scheduler->limit) {
+            break;
+        }
+        if (check_throttle(runner)) {
+            break;
+        }
+        scheduler->readyHead++;
+        launch_unit(runner, table, pipes, unit);
+    }
+}
+
+// queues a unit whose dependencies have all exited successfully
+// the queued units are moved back to the start of "ready" when it is full, 
+// as units reused by a sweep may be queued any number of times
+void queue_unit(Runner* runner, int unit) {
+    Scheduler* scheduler = runner->scheduler;
+
+    if (scheduler->readyTail == runner->size) {
+        memmove(scheduler->ready, scheduler->ready + scheduler->readyHead, 
+                (scheduler->readyTail - scheduler->readyHead) * sizeof(int));
+        scheduler->readyTail -= scheduler->readyHead;
+        scheduler->readyHead = 0;
+    }
+    scheduler->ready[scheduler->readyTail++] = unit;
+}
+
+// creates the pipes and a process for every job in a unit
+// each job is added to the pid map and given a deadline if it has a timeout
+// a pipe is created just before its first end is spawned and closed in the
+// parent just after its second end is, so few pipes are open at once
+// once every job has been spawned a relay is started for each pipe with 
+// several readers
+void launch_unit(Runner* runner, JobTable* table, PipeTable* pipes, 
+        int unit) {
+
+    int first = runner->scheduler->firsts[unit];
+
+    runner->states.queued -= runner->scheduler->sizes[unit];
+    if (runner->cacheDir != NULL && runner->scheduler->sizes[unit] == 1 && 
+            cacheable(&table->jobs[first]) && 
+            load_cache(runner, table, first)) {
+        return;
+    }
+
+    for (int i = first; i != -1; i = runner->scheduler->nextJobs[i]) {
+        Job* job = &table->jobs[i];
+        Capture* capture = NULL;
+
+        if (runner->captures != NULL) {
+            capture = &runner->captures[i];
+            open_capture(capture, job, runner->logDir);
+        }
+
+        if (runner->coreCount > 0 && job->cpus == NULL) {
+            job->cpu = pick_core(runner);
+            runner->coreJobs[job->cpu]++;
+        }
+
+        if (uses_cgroup(runner, job)) {
+            open_cgroup(runner, job);
+        }
+
+        create_pipes(runner, table, pipes, i);
+        trace_event(runner->trace, i, TRACE_SPAWN);
+        create_process(job, pipes, capture);
+        trace_event(runner->trace, i, TRACE_SPAWNED);
+
+        if (job->cgroupFd != -1) {
+            close(job->cgroupFd);
+            job->cgroupFd = -1;
+        }
+        close_job_pipes(runner->scheduler, pipes, i, job);
+
+        if (capture != NULL) {
+            watch_capture(runner, i);
+        }
+
+        if (job->pid == -1) {
+            if (capture != NULL) {
+                drain_capture(runner, table, i);
+            }
+            if (job->cpu != -1) {
+                runner->coreJobs[job->cpu]--;
+            }
+            if (uses_cgroup(runner, job)) {
+                close_cgroup(runner, job);
+            }
+            runner->states.states[i] = JOB_DONE;
+            finish_job(runner, table, i, 0);
+            continue;
+        }
+
+        runner->states.states[i] = JOB_RUNNING;
+        add_running(&runner->states, i);
+        add_pid(&runner->pidMap, job->pid, i);
+
+        if (job->timeout != 0) {
+            if (runner->deadlines.count == runner->deadlines.size) {
+                prune_deadlines(runner, table);
+            }
+            push_deadline(&runner->deadlines, job->start + job->timeout, i, 
+                    job->number);
+        }
+    }
+
+    for (int i = first; i != -1; i = runner->scheduler->nextJobs[i]) {
+        int outPipe = table->jobs[i].outPipe;
+
+        if (outPipe != -1 && pipes->pipes[outPipe].readerCount > 1 && 
+                !pipes->pipes[outPipe].error) {
+            start_relay(runner, table, pipes, outPipe);
+        }
+    }
+}
+
+// checks if a job's result may be cached with -cache
+// a job connected to others by pipes or writing to stdout can not be, as 
+// its output can not be restored, nor can a job reading jobrunner's stdin
+// or any input but a regular file or /dev/null, as the hash only covers 
+// what is in a file
+// returns 1 if it may be cached, else returns 0
+int cacheable(Job* job) {
+    struct stat info;
+
+    return job->inPipe == -1 && job->outPipe == -1 && 
+            strcmp(job->output, "-") != 0 && strcmp(job->input, "-") != 0 &&
+            (strcmp(job->input, "/dev/null") == 0 || 
+            (stat(job->input, &info) == 0 && S_ISREG(info.st_mode)));
+}
+
+// gets the FNV-1a hash of a job's command and arguments and the contents of
+// its input file, which is read when the job is launched as it may have 
+// been written by a job it depends on
+// returns the hash, or 0 if the input file can not be read
+unsigned long long hash_job(Job* job) {
+    unsigned long long hash = 14695981039346656037ULL;
+    char buffer[CACHE_CHUNK];
+
+    for (int i = 0; job->argv[i] != NULL; i++) {
+        for (int j = 0; j == 0 || job->argv[i][j - 1] != '\0'; j++) {
+            hash ^= (unsigned char)job->argv[i][j];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    int fd = open(job->input, O_RDONLY | O_CLOEXEC);
+    ssize_t got = 0;
+    while (fd != -1 && (got = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (int i = 0; i < got; i++) {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    return fd == -1 || got == -1 || hash == 0 ? 0 : hash;
+}
+
+// looks for a job's result in the -cache directory before it is launched
+// if the job's hash has a result, its output file is restored and its 
+// cached status reported without forking, as if the job had just exited
+// returns 1 if the job's result was cached, else returns 0
+int load_cache(Runner* runner, JobTable* table, int index) {
+    Job* job = &table->jobs[index];
+    char path[PATH_MAX];
+    int status;
+
+    job->hash = hash_job(job);
+    if (job->hash == 0) {
+        return 0;
+    }
+
+    snprintf(path, sizeof(path), "%s/%016llx.status", runner->cacheDir, 
+            job->hash);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int found = fscanf(file, "%d", &status) == 1;
+    fclose(file);
+
+    snprintf(path, sizeof(path), "%s/%016llx.out", runner->cacheDir, 
+            job->hash);
+    if (!found || copy_file(path, job->output) == -1) {
+        return 0;
+    }
+
+    fprintf(stderr, "Job %d exited with status %d (cached)\n", job->number, 
+            status);
+    runner->states.states[index] = JOB_DONE;
+    finish_job(runner, table, index, status == 0);
+    return 1;
+}
+
+// stores the output file and exit status of a job which has exited in the
+// -cache directory under its hash
+// any old status is removed first, then the output and the status are each
+// written to a file named after jobrunner's pid and renamed into place, so
+// a status is never found with output that is half written
+void store_cache(Runner* runner, Job* job, int status) {
+    char path[PATH_MAX], temp[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%016llx.status", runner->cacheDir, 
+            job->hash);
+    if (unlink(path) == -1 && errno != ENOENT) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%016llx.out", runner->cacheDir, 
+            job->hash);
+    snprintf(temp, sizeof(temp), "%s/%016llx.out.%d", runner->cacheDir, 
+            job->hash, (int)getpid());
+    if (copy_file(job->output, temp) == -1 || rename(temp, path) == -1) {
+        unlink(temp);
+        return;
+    }
+
+    snprintf(temp, sizeof(temp), "%s/%016llx.status.%d", runner->cacheDir, 
+            job->hash, (int)getpid());
+    FILE* file = fopen(temp, "w");
+    if (file == NULL) {
+        return;
+    }
+    fprintf(file, "%d\n", status);
+    fclose(file);
+
+    snprintf(path, sizeof(path), "%s/%016llx.status", runner->cacheDir, 
+            job->hash);
+    rename(temp, path);
+}
+
+// copies a file, replacing the file it is copied to
+// returns -1 if the file could not be copied, else returns 0
+int copy_file(char* from, char* to) {
+    char buffer[CACHE_CHUNK];
+    ssize_t got = 0;
+    int result = 0;
+
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 
+            S_IRWXU | S_IRGRP);
+
+    while (in != -1 && out != -1 && (got = read(in, buffer, 
+            sizeof(buffer))) > 0) {
+        if (write(out, buffer, got) != got) {
+            result = -1;
+            break;
+        }
+    }
+
+    if (in != -1) {
+        close(in);
+    }
+    if (out != -1) {
+        close(out);
+    }
+    return in == -1 || out == -1 || got == -1 ? -1 : result;
+}
+
+// checks if launches must be paused by -throttle, which they are while the
+// cpu or memory pressure on the host is above its threshold
+// the pressure is the share of the last 10s in which some task waited for 
+// a cpu or for memory, without /proc/pressure the load average per cpu is
+// used for the cpu instead
+// it is read at most every THROTTLE_INTERVAL ms, running jobs are never 
+// affected
+// returns 1 if launches are paused, else returns 0
+int check_throttle(Runner* runner) {
+
+    if (runner->cpuPressure == 0) {
+        return 0;
+    }
+
+    long long now = current_ms();
+    if (now - runner->throttleChecked < THROTTLE_INTERVAL) {
+        return runner->throttled;
+    }
+    runner->throttleChecked = now;
+
+    double cpu = read_pressure("/proc/pressure/cpu");
+    if (cpu < 0) {
+        cpu = read_load();
+    }
+    double memory = read_pressure("/proc/pressure/memory");
+
+    runner->throttled = cpu > runner->cpuPressure || 
+            memory > runner->memPressure;
+    return runner->throttled;
+}
+
+// reads the percent of the last 10s in which some task was stalled from a
+// pressure stall information file
+// returns the percent, or -1 if the file can not be read
+double read_pressure(char* path) {
+    double pressure = -1;
+    FILE* file = fopen(path, "r");
+
+    if (file != NULL) {
+        if (fscanf(file, "some avg10=%lf", &pressure) != 1) {
+            pressure = -1;
+        }
+        fclose(file);
+    }
+    return pressure;
+}
+
+// reads the 1 minute load average as a percent of the online cpus
+// returns the percent, or -1 if it can not be read
+double read_load(void) {
+    double load;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (getloadavg(&load, 1) != 1 || cpus <= 0) {
+        return -1;
+    }
+    return 100 * load / cpus;
+}
+
+// creates the pipes used by a job which have not been created yet
+// only pipes with one writer and at least one reader are created, a reader 
+// of a pipe with several readers gets its own pipe which the relay fills
+// both ends are close-on-exec, so each child only keeps the ends it has 
+// duplicated onto its stdin or stdout
+// each pipe is resized to its writer's pipesize= or else -pipesize if given
+void create_pipes(Runner* runner, JobTable* table, PipeTable* pipes, 
+        int index) {
+
+    Job* job = &table->jobs[index];
+    int ends[2] = {job->inPipe, job->outPipe};
+
+    for (int i = 0; i < 2; i++) {
+        if (ends[i] == -1 || pipes->pipes[ends[i]].error) {
+            continue;
+        }
+
+        int* fd = pipes->pipes[ends[i]].fd;
+        if (i == 0 && pipes->pipes[ends[i]].readerCount > 1) {
+            fd = job->fanFd;
+        } else if (fd[0] != -1) {
+            continue;
+        }
+
+        if (pipe2(fd, O_CLOEXEC) == -1) {
+            fprintf(stderr, "pipe error\n");
+            continue;
+        }
+
+        Pipe* pipe = &pipes->pipes[ends[i]];
+        int size = table->jobs[pipe->writer].pipeSize;
+        resize_pipe(runner, pipe, fd, size ? size : runner->pipeSize);
+    }
+}
+
+// sets the buffer size of a newly created pipe, limited to "pipeMax"
+// a larger buffer lets a writer run further ahead of its reader, so both 
+// switch in and out less often
+// the size the kernel rounded it to is kept in the pipe for the summary
+void resize_pipe(Runner* runner, Pipe* pipe, int* fd, int size) {
+
+    if (size == 0) {
+        return;
+    }
+
+    int actual = fcntl(fd[1], F_SETPIPE_SZ, 
+            size < runner->pipeMax ? size : runner->pipeMax);
+    if (actual == -1) {
+        actual = fcntl(fd[1], F_GETPIPE_SZ);
+    }
+    pipe->size = actual > pipe->size ? actual : pipe->size;
+}
+
+// reads the largest pipe buffer size an unprivileged process may set from
+// /proc/sys/fs/pipe-max-size
+// returns the size in bytes, or DEFAULT_PIPE_MAX if it can not be read
+int read_pipe_max(void) {
+    int max = DEFAULT_PIPE_MAX;
+    FILE* file = fopen("/proc/sys/fs/pipe-max-size", "r");
+
+    if (file != NULL) {
+        if (fscanf(file, "%d", &max) != 1) {
+            max = DEFAULT_PIPE_MAX;
+        }
+        fclose(file);
+    }
+    return max;
+}
+
+// closes the pipes of a job which has just been spawned in the parent
+// a pipe is closed once the job at its other end has been spawned too, which 
+// is always an earlier job in the same unit, or if that job is invalid
+// for a pipe with several readers only the ends used by this job are closed,
+// the relay keeps the ends it copies between
+void close_job_pipes(Scheduler* scheduler, PipeTable* pipes, int index, 
+        Job* job) {
+
+    int ends[2] = {job->inPipe, job->outPipe};
+
+    if (job->fanFd[0] != -1) {
+        close(job->fanFd[0]);
+        job->fanFd[0] = -1;
+
+        if (scheduler->unitOf[pipes->pipes[job->inPipe].writer] == -1) {
+            close(job->fanFd[1]);
+            job->fanFd[1] = -1;
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (ends[i] == -1 || pipes->pipes[ends[i]].fd[0] == -1) {
+            continue;
+        }
+
+        Pipe* pipe = &pipes->pipes[ends[i]];
+        if (pipe->readerCount > 1) {
+            close(pipe->fd[1]);
+            pipe->fd[1] = -1;
+            continue;
+        }
+
+        int other = pipe->writer == index ? pipe->reader : pipe->writer;
+
+        if (other < index || scheduler->unitOf[other] == -1) {
+            close_pipe(pipe);
+        }
+    }
+}
+
+// starts a relay from a pipe with several readers to each reader's own pipe
+// takes the index of the pipe, whose writer and readers have been spawned
+// the relay takes over the read end of the pipe and the write end of each 
+// reader's pipe, and is woken by the event loop when any of them is ready
+// if the pipes between its stages can not be created no relay is started,
+// so the writer gets SIGPIPE and each reader reads end of file
+void start_relay(Runner* runner, JobTable* table, PipeTable* pipes, 
+        int pipeIndex) {
+
+    Pipe* pipe = &pipes->pipes[pipeIndex];
+    int* outs = (int*)malloc(pipe->readerCount * sizeof(int));
+    int outCount = 0;
+
+    for (int i = pipe->reader; i != -1; i = table->jobs[i].nextReader) {
+        if (table->jobs[i].fanFd[1] != -1) {
+            outs[outCount++] = table->jobs[i].fanFd[1];
+            table->jobs[i].fanFd[1] = -1;
+        }
+    }
+
+    // each stage but the last passes its data on through a pipe of its own,
+    // sized like the pipes the readers are given
+    int count = outCount > 1 ? outCount - 1 : 1;
+    int* stages = (int*)malloc(2 * count * sizeof(int));
+    int size = table->jobs[pipe->writer].pipeSize;
+    int made = 0;
+    while (outCount > 0 && made < count - 1 && 
+            pipe2(stages + 2 * made, O_CLOEXEC) == 0) {
+        resize_pipe(runner, pipe, stages + 2 * made, 
+                size ? size : runner->pipeSize);
+        made++;
+    }
+    if (outCount > 0 && made < count - 1) {
+        fprintf(stderr, "pipe error\n");
+    }
+
+    if (outCount == 0 || pipe->fd[0] == -1 || made < count - 1) {
+        for (int i = 0; i < outCount; i++) {
+            close(outs[i]);
+        }
+        for (int i = 0; i < 2 * made; i++) {
+            close(stages[i]);
+        }
+        if (pipe->fd[0] != -1) {
+            close(pipe->fd[0]);
+            pipe->fd[0] = -1;
+        }
+        free(outs);
+        free(stages);
+        return;
+    }
+
+    runner->relays = (Relay*)realloc(runner->relays, 
+            (runner->relayCount + 1) * sizeof(Relay));
+    Relay* relay = &runner->relays[runner->relayCount];
+
+    relay->ins = (int*)malloc(count * sizeof(int));
+    relay->tees = (int*)malloc(count * sizeof(int));
+    relay->nexts = (int*)malloc(count * sizeof(int));
+    relay->pending = (size_t*)calloc(count, sizeof(size_t));
+    relay->count = count;
+    relay->alive = outCount;
+
+    relay->ins[0] = pipe->fd[0];
+    pipe->fd[0] = -1;
+
+    for (int i = 0; i < count; i++) {
+        relay->tees[i] = outCount > 1 ? outs[i] : -1;
+
+        if (i == count - 1) {
+            relay->nexts[i] = outs[outCount - 1];
+        } else {
+            relay->nexts[i] = stages[2 * i + 1];
+            relay->ins[i + 1] = stages[2 * i];
+        }
+    }
+    free(stages);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.data.u64 = EVENT_RELAY | (uint64_t)runner->relayCount << EVENT_BITS;
+    event.events = EPOLLIN | EPOLLET;
+    epoll_ctl(runner->epollFd, EPOLL_CTL_ADD, relay->ins[0], &event);
+
+    event.events = EPOLLOUT | EPOLLET;
+    for (int i = 0; i < outCount; i++) {
+        epoll_ctl(runner->epollFd, EPOLL_CTL_ADD, outs[i], &event);
+    }
+
+    runner->relayCount++;
+    free(outs);
+    pump_relay(relay);
+}
+
+// moves data through every stage of a relay until none can make progress
+// all its readers having exited, the relay is closed so the writer gets 
+// SIGPIPE as it would writing to a pipe with no readers
+void pump_relay(Relay* relay) {
+    int progress = 1;
+
+    while (progress && relay->alive > 0) {
+        progress = 0;
+
+        for (int i = 0; i < relay->count; i++) {
+            progress |= pump_stage(relay, i);
+        }
+    }
+
+    if (relay->alive == 0) {
+        close_relay(relay);
+    }
+}
+
+// moves data through one stage of a relay without blocking
+// the bytes teed to this stage's reader are spliced on before any more are 
+// teed, so every reader gets the same data, and the stage finishes once its
+// input is at end of file
+// returns 1 if the stage made any progress, else returns 0
+int pump_stage(Relay* relay, int i) {
+    ssize_t moved;
+
+    if (relay->ins[i] == -1) {
+        return 0;
+    } else if (relay->pending[i] > 0) {
+        moved = splice(relay->ins[i], NULL, relay->nexts[i], NULL, 
+                relay->pending[i], SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            relay->pending[i] -= moved;
+        }
+    } else if (relay->tees[i] != -1) {
+        moved = tee(relay->ins[i], relay->tees[i], RELAY_CHUNK, 
+                SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            relay->pending[i] = moved;
+        } else if (moved == -1 && errno == EPIPE) {
+            close(relay->tees[i]);
+            relay->tees[i] = -1;
+            relay->alive--;
+            return 1;
+        }
+    } else {
+        moved = splice(relay->ins[i], NULL, relay->nexts[i], NULL, 
+                RELAY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    }
+
+    if (moved > 0) {
+        return 1;
+    } else if (moved == -1 && errno == EPIPE) {
+        // only the last reader's pipe can be closed, the rest of the data 
+        // for it is thrown away
+        close(relay->nexts[i]);
+        relay->nexts[i] = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        relay->alive--;
+        return 1;
+    } else if (moved == -1) {
+        return 0;
+    }
+
+    close(relay->ins[i]);
+    close(relay->nexts[i]);
+    if (relay->tees[i] != -1) {
+        close(relay->tees[i]);
+    }
+    relay->ins[i] = -1;
+    relay->tees[i] = -1;
+    relay->nexts[i] = -1;
+    return 1;
+}
+
+// closes every file descriptor a relay still holds
+void close_relay(Relay* relay) {
+    for (int i = 0; i < relay->count; i++) {
+        if (relay->ins[i] == -1) {
+            continue;
+        }
+
+        close(relay->ins[i]);
+        close(relay->nexts[i]);
+        if (relay->tees[i] != -1) {
+            close(relay->tees[i]);
+        }
+        relay->ins[i] = -1;
+        relay->tees[i] = -1;
+        relay->nexts[i] = -1;
+    }
+}
+
+// opens the pipes that capture a job's stdout and stderr before it is spawned
+// stdout is only captured if the job would otherwise inherit it, the read 
+// ends are non-blocking so draining them never stalls the event loop
+// with -logs the job's log file "logDir/N.log" is created too
+void open_capture(Capture* capture, Job* job, char* logDir) {
+    capture->logFd = -1;
+    capture->logged = 0;
+
+    for (int i = 0; i < 2; i++) {
+        capture->fds[i] = -1;
+        capture->childFds[i] = -1;
+        capture->lines[i] = NULL;
+        capture->lengths[i] = 0;
+
+        int fd[2];
+        if ((i == 0 && (job->outPipe != -1 || strcmp(job->output, "-") != 0))
+                || pipe2(fd, O_CLOEXEC) == -1) {
+            continue;
+        }
+
+        fcntl(fd[0], F_SETFL, O_NONBLOCK);
+        capture->fds[i] = fd[0];
+        capture->childFds[i] = fd[1];
+        if (logDir == NULL) {
+            capture->lines[i] = (char*)malloc(CAPTURE_LINE);
+        }
+    }
+
+    if (logDir != NULL) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%d.log", logDir, job->number);
+        capture->logFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                S_IRUSR | S_IWUSR | S_IRGRP);
+    }
+}
+
+// closes the write ends of a job's capture pipes once it has been spawned
+// and adds the read ends to the event loop
+void watch_capture(Runner* runner, int job) {
+    Capture* capture = &runner->captures[job];
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = runner->merged.paused ? 0 : EPOLLIN;
+
+    for (int i = 0; i < 2; i++) {
+        if (capture->childFds[i] == -1) {
+            continue;
+        }
 
-            for (int i = 0; i < invalidJobs->invjobCount; i++) {
-                if (*timeCount == invalidJobs->invJobs[i]) {
-                    pass = 1;
-                    (*invalidCount)++;
+        close(capture->childFds[i]);
+        capture->childFds[i] = -1;
+
+        event.data.u64 = EVENT_CAPTURE | 
+                (uint64_t)(2 * job + i) << EVENT_BITS;
+        epoll_ctl(runner->epollFd, EPOLL_CTL_ADD, capture->fds[i], &event);
+    }
+}
+
+// reads what is waiting in one of a job's captured streams, stream 0 being 
+// stdout and 1 stderr, and writes it to the merged output or the job's log
+// the stream is closed once the job has closed its end
+// returns 1 if anything was read, else returns 0
+int read_capture(Runner* runner, JobTable* table, int job, int stream) {
+    Capture* capture = &runner->captures[job];
+    char buffer[CAPTURE_CHUNK];
+
+    if (capture->fds[stream] == -1) {
+        return 0;
+    }
+
+    ssize_t count = read(capture->fds[stream], buffer, sizeof(buffer));
+    if (count > 0) {
+        if (runner->logDir != NULL) {
+            write_log(capture, buffer, count);
+        } else {
+            write_lines(&runner->merged, capture, table->jobs[job].number, 
+                    stream, buffer, count);
+        }
+        return 1;
+    } else if (count == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return 0;
+    }
+
+    close_capture(&runner->merged, capture, table->jobs[job].number, 
+            stream);
+    return 0;
+}
+
+// reads everything left in a job's captured streams once it has exited, 
+// then closes them even if a process the job started still holds them open
+void drain_capture(Runner* runner, JobTable* table, int job) {
+    Capture* capture = &runner->captures[job];
+
+    for (int i = 0; i < 2; i++) {
+        while (read_capture(runner, table, job, i)) {
+            ;
+        }
+        if (capture->fds[i] != -1) {
+            close_capture(&runner->merged, capture, 
+                    table->jobs[job].number, i);
+        }
+    }
+    flush_merged(runner);
+}
+
+// closes one of a job's captured streams, writing out any partial last line
+// the job's log is closed along with its last stream
+void close_capture(Merged* merged, Capture* capture, int number, 
+        int stream) {
+
+    if (capture->lengths[stream] > 0) {
+        write_lines(merged, capture, number, stream, "\n", 1);
+    }
+
+    close(capture->fds[stream]);
+    capture->fds[stream] = -1;
+    free(capture->lines[stream]);
+    capture->lines[stream] = NULL;
+
+    if (capture->fds[0] == -1 && capture->fds[1] == -1 && 
+            capture->logFd != -1) {
+        close(capture->logFd);
+        capture->logFd = -1;
+    }
+}
+
+// adds each complete line of captured output to the merged output, 
+// prefixed by the job number and ':' for stdout or '!' for stderr
+// a partial line is kept until the rest of it is read, a line longer than
+// CAPTURE_LINE is split so that memory use stays bounded
+void write_lines(Merged* merged, Capture* capture, int number, int stream, 
+        char* data, int count) {
+
+    char* line = capture->lines[stream];
+    char tag = stream == 0 ? ':' : '!';
+
+    while (count > 0) {
+        char* end = memchr(data, '\n', count);
+        int length = end != NULL ? end - data : count;
+
+        if (length > CAPTURE_LINE - capture->lengths[stream]) {
+            length = CAPTURE_LINE - capture->lengths[stream];
+            end = NULL;
+        }
+
+        memcpy(line + capture->lengths[stream], data, length);
+        capture->lengths[stream] += length;
+        data += length;
+        count -= length;
+
+        if (end != NULL) {
+            data++;
+            count--;
+        } else if (capture->lengths[stream] < CAPTURE_LINE) {
+            continue;
+        }
+
+        // room for the number, the tag, the line and its newline
+        int room = capture->lengths[stream] + 16;
+        if (merged->size - merged->length < room) {
+            while (merged->size - merged->length < room) {
+                merged->size = merged->size ? 2 * merged->size : 
+                        CAPTURE_CHUNK;
+            }
+            merged->buffer = (char*)realloc(merged->buffer, merged->size);
+        }
+        merged->length += sprintf(merged->buffer + merged->length, 
+                "%d%c %.*s\n", number, tag, capture->lengths[stream], line);
+        capture->lengths[stream] = 0;
+    }
+}
+
+// prepares the merged output, making stdout non-blocking if "capture" is 
+// set and the output is merged rather than logged
+void open_merged(Merged* merged, int capture) {
+    merged->buffer = NULL;
+    merged->length = 0;
+    merged->size = 0;
+    merged->flags = -1;
+    merged->watched = 0;
+    merged->paused = 0;
+
+    if (capture) {
+        fflush(stdout);
+        merged->flags = fcntl(STDOUT_FILENO, F_GETFL);
+        if (merged->flags != -1) {
+            fcntl(STDOUT_FILENO, F_SETFL, merged->flags | O_NONBLOCK);
+        }
+    }
+}
+
+// writes as much of the merged output as stdout accepts without blocking
+// the event loop is woken when stdout can accept more, and captured streams
+// stop being read while MERGED_LIMIT bytes are waiting, so the jobs block 
+// on their own pipes instead of jobrunner using more memory
+void flush_merged(Runner* runner) {
+    Merged* merged = &runner->merged;
+    int written = 0;
+
+    while (written < merged->length) {
+        ssize_t count = write(STDOUT_FILENO, merged->buffer + written, 
+                merged->length - written);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            break;
+        }
+        written += count;
+    }
+    merged->length -= written;
+    memmove(merged->buffer, merged->buffer + written, merged->length);
+
+    // a regular file can not be watched by epoll, but never blocks either
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLOUT;
+    event.data.u64 = EVENT_STDOUT;
+    if (merged->length > 0 && !merged->watched) {
+        merged->watched = epoll_ctl(runner->epollFd, EPOLL_CTL_ADD, 
+                STDOUT_FILENO, &event) == 0;
+    } else if (merged->length == 0 && merged->watched) {
+        epoll_ctl(runner->epollFd, EPOLL_CTL_DEL, STDOUT_FILENO, NULL);
+        merged->watched = 0;
+    }
+
+    if (!merged->paused && merged->length >= MERGED_LIMIT) {
+        pause_captures(runner, 1);
+    } else if (merged->paused && merged->length <= MERGED_RESUME) {
+        pause_captures(runner, 0);
+    }
+}
+
+// stops or resumes reading the captured streams of every running job
+void pause_captures(Runner* runner, int paused) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = paused ? 0 : EPOLLIN;
+    runner->merged.paused = paused;
+
+    for (int i = 0; i < runner->states.running; i++) {
+        int job = runner->states.runningJobs[i];
+
+        for (int j = 0; j < 2; j++) {
+            if (runner->captures[job].fds[j] != -1) {
+                event.data.u64 = EVENT_CAPTURE | 
+                        (uint64_t)(2 * job + j) << EVENT_BITS;
+                epoll_ctl(runner->epollFd, EPOLL_CTL_MOD, 
+                        runner->captures[job].fds[j], &event);
+            }
+        }
+    }
+}
+
+// restores stdout's file status flags and writes out what is left of the 
+// merged output, blocking until it is written as jobrunner is finishing
+void close_merged(Merged* merged) {
+    int written = 0;
+
+    if (merged->flags != -1) {
+        fcntl(STDOUT_FILENO, F_SETFL, merged->flags);
+    }
+    while (written < merged->length) {
+        ssize_t count = write(STDOUT_FILENO, merged->buffer + written, 
+                merged->length - written);
+        if (count == -1 && errno == EINTR) {
+            continue;
+        } else if (count <= 0) {
+            break;
+        }
+        written += count;
+    }
+    free(merged->buffer);
+}
+
+// writes captured output to a job's log until it reaches LOG_LIMIT bytes
+// the rest of the output is read but thrown away, with a note in the log
+void write_log(Capture* capture, char* data, int count) {
+    char* truncMsg = "\n[jobrunner: log truncated]\n";
+
+    if (capture->logFd == -1 || capture->logged > LOG_LIMIT) {
+        return;
+    }
+
+    int length = count;
+    if (length > LOG_LIMIT - capture->logged) {
+        length = LOG_LIMIT - capture->logged;
+    }
+
+    write(capture->logFd, data, length);
+    capture->logged += length;
+
+    if (length < count) {
+        write(capture->logFd, truncMsg, strlen(truncMsg));
+        capture->logged++;
+    }
+}
+
+// creates a process to be executed
+// takes a job from the job table and the pipe table as parameters
+// the job is launched with spawn_job(), if that fails the job is forked and
+// exec_job() is called in the child, so a job that can not be executed still
+// exits with status 255
+// a job whose scheduling, limits or cgroup are changed is always forked, as 
+// posix_spawnp() can not set them between fork and exec
+// "capture" holds the pipes for the job's stdout and stderr (NULL if its 
+// output is not captured)
+void create_process(Job* job, PipeTable* pipes, Capture* capture) {
+
+    job->start = current_ms();
+    pid_t id = -1;
+    if (!needs_fork(job)) {
+        id = spawn_job(job, pipes, capture);
+    }
+
+    if (id == -1) {
+        id = fork();
+
+        if (id == 0) {
+            exec_job(job, pipes, capture);
+        }
+    }
+    job->pid = id;
+}
+
+// launches a job with posix_spawnp(), which does not copy the parent's page
+// tables like fork() does
+// the redirections made by exec_job() are done with file actions instead
+// returns the pid of the job, or -1 if it could not be spawned
+pid_t spawn_job(Job* job, PipeTable* pipes, Capture* capture) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    if (job->inPipe != -1) {
+        if (find_pipe_fd(job, pipes, 1) != -1) {
+            posix_spawn_file_actions_adddup2(&actions, 
+                    find_pipe_fd(job, pipes, 1), 0);
+        }
+    } else if (strcmp(job->input, "-") != 0) {
+        posix_spawn_file_actions_addopen(&actions, 0, job->input, O_RDONLY, 
+                0);
+    }
+
+    if (job->outPipe != -1) {
+        if (find_pipe_fd(job, pipes, 2) != -1) {
+            posix_spawn_file_actions_adddup2(&actions, 
+                    find_pipe_fd(job, pipes, 2), 1);
+        }
+    } else if (strcmp(job->output, "-") != 0) {
+        posix_spawn_file_actions_addopen(&actions, 1, job->output, 
+                O_WRONLY | O_CREAT | O_TRUNC, S_IRWXU | S_IRGRP);
+    } else if (capture != NULL && capture->childFds[0] != -1) {
+        posix_spawn_file_actions_adddup2(&actions, capture->childFds[0], 1);
+    }
+
+    if (capture != NULL && capture->childFds[1] != -1) {
+        posix_spawn_file_actions_adddup2(&actions, capture->childFds[1], 2);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 
+                0);
+    }
+
+    // the child starts with the signals blocked by block_signals() 
+    // unblocked, as in exec_job()
+    sigset_t mask;
+    sigprocmask(SIG_SETMASK, NULL, &mask);
+    sigdelset(&mask, SIGCHLD);
+    sigdelset(&mask, SIGHUP);
+    sigdelset(&mask, SIGPIPE);
+    sigdelset(&mask, SIGUSR1);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, job->argv[0], &actions, &attr, job->argv, 
+            environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    return error ? -1 : pid;
+}
+
+// blocks SIGCHLD, SIGHUP and SIGUSR1 so they can be read from a signalfd
+// must be called before any jobs are forked so no SIGCHLD is discarded
+// SIGPIPE is blocked too, so a relay writing to a reader that has exited 
+// gets EPIPE instead
+void block_signals(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGPIPE);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+}
+
+// unblocks SIGCHLD, SIGHUP, SIGPIPE and SIGUSR1, called in each child before
+// it is executed as the signal mask is inherited through execvp()
+void unblock_signals(void) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGPIPE);
+    sigaddset(&mask, SIGUSR1);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+// launches jobs and waits for all child processes, reaping each one as soon 
+// as it exits and launching units as their dependencies finish
+// blocks in epoll_wait() until a child exits, a sighup is received or the
+// timerfd for the next job deadline expires, so no cpu time is used while 
+// jobs are running
+// the status of the jobs is printed each time a SIGUSR1 is received
+// if "intake" is not NULL the jobfile is read by the same loop, and jobs are
+// launched as they arrive until it ends
+// events in the life of each job are recorded if "trace" is not NULL
+// returns the makespan, the time in ms from the first launch to the last exit
+long long wait_for_process(JobTable* table, PipeTable* pipes, 
+        Scheduler* scheduler, Options* options, Intake* intake, 
+        Trace* trace) {
+
+    prepare_for_wait();
+    long long start = current_ms();
+    int grace = options->grace;
+
+    Runner runner;
+    runner.epollFd = setup_event_loop(&runner.sigFd, &runner.timerFd);
+    runner.grace = grace;
+    runner.stats = options->stats;
+    runner.scheduler = scheduler;
+    runner.relays = NULL;
+    runner.relayCount = 0;
+    runner.logDir = options->logDir;
+    runner.intake = intake;
+    runner.trace = trace;
+    runner.pipeSize = options->pipeSize;
+    runner.pipeMax = read_pipe_max();
+    runner.cgroup = NULL;
+    runner.cgroupHome = NULL;
+    runner.cacheDir = options->cacheDir;
+    runner.cpuPressure = options->cpuPressure;
+    runner.memPressure = options->memPressure;
+    runner.throttled = 0;
+    runner.throttleChecked = start - THROTTLE_INTERVAL;
+    if (options->cgroup) {
+        setup_cgroup(&runner);
+    }
+    runner.size = table->count;
+    runner.cores = NULL;
+    runner.coreJobs = NULL;
+    runner.coreCount = 0;
+    if (options->pin) {
+        find_cores(&runner);
+    }
+    runner.captures = NULL;
+    if (options->capture) {
+        runner.captures = (Capture*)malloc(table->count * sizeof(Capture));
+    }
+    open_merged(&runner.merged, options->capture && options->logDir == NULL);
+    create_pid_map(&runner.pidMap, table->count);
+
+    runner.states.states = (int*)calloc(table->count, sizeof(int));
+    runner.states.runningJobs = (int*)malloc(table->count * sizeof(int));
+    runner.states.slots = (int*)malloc(table->count * sizeof(int));
+    runner.states.running = 0;
+    runner.states.killedAll = 0;
+    runner.states.queued = 0;
+    runner.states.succeeded = 0;
+    runner.states.failed = 0;
+    runner.states.skipped = 0;
+
+    runner.deadlines.size = table->count + 1;
+    runner.deadlines.count = 0;
+    runner.deadlines.times = (long long*)malloc(runner.deadlines.size * 
+            sizeof(long long));
+    runner.deadlines.jobs = (int*)malloc(runner.deadlines.size * sizeof(int));
+    runner.deadlines.numbers = (int*)malloc(runner.deadlines.size * 
+            sizeof(int));
+
+    // invalid jobs are never launched or waited for
+    for (int i = 0; i < table->count; i++) {
+        runner.states.states[i] = JOB_DONE;
+    }
+    for (int i = 0; i < scheduler->unitCount; i++) {
+        for (int j = scheduler->firsts[i]; j != -1; 
+                j = scheduler->nextJobs[j]) {
+            runner.states.states[j] = JOB_QUEUED;
+            runner.states.queued++;
+        }
+    }
+
+    if (intake != NULL) {
+        intake->base = table->count;
+        create_pid_map(&intake->jobMap, table->count);
+        watch_intake(&runner, table, pipes);
+    }
+
+    launch_units(&runner, table, pipes);
+    feed_sweep(&runner, table, pipes);
+    while (runner.states.running > 0 || 
+            (scheduler->readyHead < scheduler->readyTail && !sighup) || 
+            (intake != NULL && intake->fd != -1)) {
+
+        if (sighup && intake != NULL && intake->fd != -1) {
+            close_intake(&runner, table, pipes);
+        }
+
+        if (sighup && !runner.states.killedAll) {
+            for (int i = 0; i < table->count; i++) {
+                if (runner.states.states[i] != JOB_DONE && 
+                        runner.states.states[i] != JOB_QUEUED) {
+                    kill(table->jobs[i].pid, SIGKILL);
+                }
+            }
+            runner.states.killedAll = 1;
+        }
+
+        check_timeouts(&runner, table);
+
+        struct epoll_event events[MAX_EVENTS];
+        int statusWanted = 0;
+        // launches paused by -throttle are retried once the pressure has
+        // been read again
+        int timeout = runner.throttled && 
+                scheduler->readyHead < scheduler->readyTail ? 
+                THROTTLE_INTERVAL : -1;
+        int eventCount = epoll_wait(runner.epollFd, events, MAX_EVENTS, 
+                timeout);
+        for (int i = 0; i < eventCount; i++) {
+            int type = events[i].data.u64 & ((1 << EVENT_BITS) - 1);
+            int index = events[i].data.u64 >> EVENT_BITS;
+
+            if (type == EVENT_SIGNAL) {
+                statusWanted |= read_signals(runner.sigFd);
+            } else if (type == EVENT_TIMER) {
+                uint64_t expirations;
+                read(runner.timerFd, &expirations, sizeof(expirations));
+            } else if (type == EVENT_RELAY) {
+                pump_relay(&runner.relays[index]);
+            } else if (type == EVENT_INTAKE) {
+                read_intake(&runner, table, pipes);
+            } else if (type == EVENT_CAPTURE) {
+                read_capture(&runner, table, index / 2, index % 2);
+            }
+        }
+        flush_merged(&runner);
+        reap_children(&runner, table);
+        launch_units(&runner, table, pipes);
+        feed_sweep(&runner, table, pipes);
+        if (statusWanted) {
+            print_status(&runner, table);
+        }
+    }
+
+    for (int i = 0; i < runner.relayCount; i++) {
+        close_relay(&runner.relays[i]);
+        free(runner.relays[i].ins);
+        free(runner.relays[i].tees);
+        free(runner.relays[i].nexts);
+        free(runner.relays[i].pending);
+    }
+    free(runner.relays);
+    free(runner.captures);
+    close_merged(&runner.merged);
+    free(runner.cores);
+    free(runner.coreJobs);
+    remove_cgroup(&runner, table);
+
+    if (intake != NULL) {
+        free(intake->buffer);
+        free(intake->parents);
+        free(intake->heads);
+        free(intake->jobMap.pids);
+        free(intake->jobMap.indices);
+        free(intake->failedJobs.invJobs);
+    }
+
+    close(runner.sigFd);
+    close(runner.timerFd);
+    close(runner.epollFd);
+    free(runner.pidMap.pids);
+    free(runner.pidMap.indices);
+    free(runner.states.states);
+    free(runner.states.runningJobs);
+    free(runner.states.slots);
+    free(runner.deadlines.times);
+    free(runner.deadlines.jobs);
+    free(runner.deadlines.numbers);
+    return current_ms() - start;
+}
+
+// creates a signalfd for SIGCHLD, SIGHUP and SIGUSR1, a CLOCK_MONOTONIC 
+// timerfd and an epoll instance watching both of them
+// takes pointers to store the signalfd and timerfd in, returns the epoll fd
+int setup_event_loop(int* sigFd, int* timerFd) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+    *sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    *timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = EVENT_SIGNAL;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, *sigFd, &event);
+    event.data.u64 = EVENT_TIMER;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, *timerFd, &event);
+
+    return epollFd;
+}
+
+// opens the jobfile given with -stream for reading, "-" meaning stdin
+// opening a FIFO waits until a writer has opened it too
+// exits with status 2 if the jobfile can not be opened
+void open_intake(Intake* intake, char* name, InvalidJobs* invalidJobs, 
+        int verbose) {
+
+    int fd = STDIN_FILENO;
+    if (strcmp(name, "-") != 0) {
+        fd = open(name, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd == -1) {
+        file_error(name);
+    }
+    init_intake(intake, fd, name, invalidJobs, verbose);
+}
+
+// prepares an intake to read the jobfile "name" from "fd"
+void init_intake(Intake* intake, int fd, char* name, 
+        InvalidJobs* invalidJobs, int verbose) {
+
+    intake->fd = fd;
+    intake->name = name;
+    intake->files = NULL;
+    intake->fileCount = 0;
+    intake->size = INTAKE_CHUNK;
+    intake->buffer = (char*)malloc(intake->size);
+    intake->length = 0;
+    intake->line = 1;
+    intake->verbose = verbose;
+    intake->parents = (int*)malloc(0);
+    intake->heads = (int*)malloc(0);
+    intake->invalidJobs = invalidJobs;
+    intake->sweep.count = 0;
+    intake->ended = 0;
+    intake->failedJobs.invjobCount = 0;
+    intake->failedJobs.size = 0;
+    intake->failedJobs.invJobs = (unsigned long*)malloc(0);
+}
+
+// adds the streamed jobfile to the event loop
+// a regular file can not be watched by epoll, but never blocks either, so 
+// it is read to the end at once
+void watch_intake(Runner* runner, JobTable* table, PipeTable* pipes) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = EVENT_INTAKE;
+
+    if (epoll_ctl(runner->epollFd, EPOLL_CTL_ADD, runner->intake->fd, 
+            &event) == -1) {
+        while (runner->intake->fd != -1 && !runner->intake->ended) {
+            read_intake(runner, table, pipes);
+        }
+    }
+}
+
+// reads what is available from the streamed jobfile and admits each 
+// complete line, the rest is kept until its newline arrives
+// while a sweep is being admitted the lines are only kept
+void read_intake(Runner* runner, JobTable* table, PipeTable* pipes) {
+    Intake* intake = runner->intake;
+
+    if (intake->length == intake->size) {
+        intake->size *= 2;
+        intake->buffer = (char*)realloc(intake->buffer, intake->size);
+    }
+
+    ssize_t got = read(intake->fd, intake->buffer + intake->length, 
+            intake->size - intake->length);
+
+    if (got == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    } else if (got > 0) {
+        intake->length += got;
+        if (intake->sweep.count == 0) {
+            admit_lines(runner, table, pipes);
+        }
+        return;
+    }
+
+    epoll_ctl(runner->epollFd, EPOLL_CTL_DEL, intake->fd, NULL);
+    intake->ended = 1;
+    if (intake->sweep.count == 0) {
+        admit_lines(runner, table, pipes);
+    }
+}
+
+// admits each complete line kept from the streamed jobfile until one of 
+// them is a sweep, whose jobs must be admitted before the lines after it
+// at the end of the jobfile the last line is admitted even without a 
+// newline, and the jobfile is closed once it has no sweep left unless 
+// another jobfile follows it
+void admit_lines(Runner* runner, JobTable* table, PipeTable* pipes) {
+    Intake* intake = runner->intake;
+    int start = 0;
+
+    for (int i = 0; i < intake->length && intake->sweep.count == 0; i++) {
+        if (intake->buffer[i] == '\n') {
+            admit_line(runner, table, pipes, 
+                    strndup(intake->buffer + start, i - start));
+            start = i + 1;
+        }
+    }
+    intake->length -= start;
+    memmove(intake->buffer, intake->buffer + start, intake->length);
+
+    if (intake->ended && intake->sweep.count == 0 && intake->length > 0) {
+        admit_line(runner, table, pipes, 
+                strndup(intake->buffer, intake->length));
+        intake->length = 0;
+    }
+    if (intake->ended && intake->sweep.count == 0 && 
+            !next_jobfile(runner, table, pipes)) {
+        close_intake(runner, table, pipes);
+    }
+}
+
+// moves the intake on to the next jobfile once the one it was reading has 
+// ended, as the jobfiles of a run without -stream are read in turn
+// returns 1 if the next jobfile was opened, else returns 0
+int next_jobfile(Runner* runner, JobTable* table, PipeTable* pipes) {
+    Intake* intake = runner->intake;
+
+    if (intake->fileCount == 0) {
+        return 0;
+    }
+    int fd = open(intake->files[0], O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return 0;
+    }
+
+    close(intake->fd);
+    intake->fd = fd;
+    intake->name = intake->files[0];
+    intake->files++;
+    intake->fileCount--;
+    intake->line = 1;
+    intake->ended = 0;
+    watch_intake(runner, table, pipes);
+    return 1;
+}
+
+// admits the jobs of the sweep being streamed while fewer than SWEEP_AHEAD
+// jobs are queued, launching each as soon as it may run, so a sweep of any
+// size is only expanded as fast as its jobs are launched
+// each job leaves the job table once it has finished, so the table only 
+// holds the jobs of the sweep that are queued or running
+// once the sweep is finished the lines kept after it are admitted
+void feed_sweep(Runner* runner, JobTable* table, PipeTable* pipes) {
+    Intake* intake = runner->intake;
+
+    while (intake != NULL && intake->sweep.count > 0 && 
+            runner->states.queued < SWEEP_AHEAD && !sighup) {
+        char* line = next_sweep_line(&intake->sweep);
+        int index;
+
+        if (line == NULL) {
+            end_sweep(&intake->sweep);
+            admit_lines(runner, table, pipes);
+        } else if ((index = add_job(line, table, pipes, intake->invalidJobs, 
+                runner->trace)) == -1) {
+            invalid_line(intake->sweepLine, intake->name);
+        } else {
+            table->jobs[index].sweep = 1;
+            admit_job(runner, table, pipes, index);
+        }
+        launch_units(runner, table, pipes);
+    }
+}
+
+// adds one line of the streamed jobfile to the job table and the scheduler
+// blank lines and comments are skipped as in read_file(), but an invalid 
+// line only prints its message, as jobs before it may already be running
+// the jobs of a sweep are left for feed_sweep() to admit
+void admit_line(Runner* runner, JobTable* table, PipeTable* pipes, 
+        char* line) {
+
+    Intake* intake = runner->intake;
+    int count = intake->line++;
+    int swept = 0, index;
+
+    if (strlen(line) == 0 || isspace((int)line[0]) != 0 || line[0] == '#' || 
+            (swept = start_sweep(line, &intake->sweep)) != 0) {
+        free(line);
+        intake->sweepLine = count;
+        if (swept == -1) {
+            invalid_line(count, intake->name);
+        }
+    } else if ((index = add_job(line, table, pipes, intake->invalidJobs, 
+            runner->trace)) == -1) {
+        invalid_line(count, intake->name);
+    } else {
+        admit_job(runner, table, pipes, index);
+    }
+}
+
+// adds a job read from the stream to the scheduler
+// the job joins the group of every job it shares a pipe with, and its group
+// becomes a unit as soon as the job completes its last pipe
+// an invalid job still completes the pipes of the jobs at their other ends,
+// which read end of file or are sent SIGPIPE as with read_file()
+// jobs reading the stream's stdin read /dev/null instead
+void admit_job(Runner* runner, JobTable* table, PipeTable* pipes, 
+        int index) {
+
+    Intake* intake = runner->intake;
+    Scheduler* scheduler = runner->scheduler;
+
+    grow_runner(runner, table->count);
+    runner->states.states[index] = JOB_DONE;
+    scheduler->nextJobs[index] = -1;
+    scheduler->unitOf[index] = -1;
+    scheduler->depHeads[index] = -1;
+    intake->parents[index] = index;
+    intake->heads[index] = index;
+
+    Job* job = &table->jobs[index];
+    add_pid(&intake->jobMap, job->number, index);
+    if (!check_stream_pipes(runner, table, pipes, index)) {
+        retire_job(runner, table, index);
+        return;
+    }
+
+    int valid = !is_invalid_job(intake->invalidJobs, job->number);
+    if (valid && intake->verbose) {
+        verbose_job(job);
+    }
+    if (strcmp(intake->name, "-") == 0 && strcmp(job->input, "-") == 0) {
+        job->input = "/dev/null";
+    }
+
+    int ends[2] = {job->inPipe, job->outPipe};
+    for (int i = 0; i < 2; i++) {
+        if (ends[i] == -1) {
+            continue;
+        }
+
+        Pipe* pipe = &pipes->pipes[ends[i]];
+        if (valid) {
+            join_groups(runner, table, index, pipe->writer);
+        } else if (pipe->writer != -1) {
+            complete_group(runner, table, pipes, pipe->writer);
+        }
+
+        for (int j = pipe->reader; j != -1; j = table->jobs[j].nextReader) {
+            if (valid) {
+                join_groups(runner, table, index, j);
+            } else {
+                complete_group(runner, table, pipes, j);
+            }
+        }
+    }
+
+    if (valid) {
+        complete_group(runner, table, pipes, index);
+    } else {
+        retire_job(runner, table, index);
+    }
+}
+
+// forms the group of a valid job from the stream into a unit if every pipe 
+// used by the group has a writer and a reader
+void complete_group(Runner* runner, JobTable* table, PipeTable* pipes, 
+        int index) {
+
+    Intake* intake = runner->intake;
+    Scheduler* scheduler = runner->scheduler;
+
+    if (scheduler->unitOf[index] != -1 || 
+            is_invalid_job(intake->invalidJobs, table->jobs[index].number)) {
+        return;
+    }
+
+    int first = intake->heads[find_root(intake->parents, index)];
+    for (int i = first; i != -1; i = scheduler->nextJobs[i]) {
+        int ends[2] = {table->jobs[i].inPipe, table->jobs[i].outPipe};
+
+        for (int j = 0; j < 2; j++) {
+            if (ends[j] != -1 && (pipes->pipes[ends[j]].writer == -1 || 
+                    pipes->pipes[ends[j]].reader == -1)) {
+                return;
+            }
+        }
+    }
+    form_unit(runner, table, first);
+}
+
+// checks the pipes of a job read from the stream
+// a pipe with two writers, which the job both reads and writes or whose 
+// other jobs have already formed a unit can not be used, so the job is taken
+// off its pipes again and made invalid
+// returns 1 if the job's pipes can be used, else returns 0
+int check_stream_pipes(Runner* runner, JobTable* table, PipeTable* pipes, 
+        int index) {
+
+    char* invPipeMsg1 = "Invalid pipe usage \"";
+    char* invPipeMsg2 = "\"";
+    int* unitOf = runner->scheduler->unitOf;
+    Job* job = &table->jobs[index];
+    int ends[2] = {job->inPipe, job->outPipe};
+    int errors[2] = {0, 0};
+
+    for (int i = 0; i < 2; i++) {
+        if (ends[i] == -1) {
+            continue;
+        }
+
+        Pipe* pipe = &pipes->pipes[ends[i]];
+        errors[i] = pipe->error || 
+                (pipe->writer != -1 && unitOf[pipe->writer] != -1);
+        for (int j = pipe->reader; j != -1; j = table->jobs[j].nextReader) {
+            errors[i] |= unitOf[j] != -1;
+        }
+    }
+
+    if (!errors[0] && !errors[1]) {
+        return 1;
+    }
+
+    if (job->outPipe != -1) {
+        Pipe* pipe = &pipes->pipes[job->outPipe];
+        if (pipe->writer == index) {
+            pipe->writer = -1;
+        }
+        pipe->error = 0;
+    }
+    if (job->inPipe != -1) {
+        Pipe* pipe = &pipes->pipes[job->inPipe];
+        pipe->reader = job->nextReader;
+        pipe->readerCount--;
+        pipe->error = 0;
+    }
+
+    // a job reading and writing the same pipe reports it once
+    for (int i = 0; i < 2; i++) {
+        if (errors[i] && (i == 0 || ends[1] != ends[0] || !errors[0])) {
+            fprintf(stderr, "%s%s%s\n", invPipeMsg1, 
+                    pipes->pipes[ends[i]].name + 1, invPipeMsg2);
+        }
+    }
+    job->inPipe = -1;
+    job->outPipe = -1;
+    job->nextReader = -1;
+    add_invalid_job(runner->intake->invalidJobs, job->number);
+    return 0;
+}
+
+// joins the groups of a job and another job at the end of one of its pipes
+// invalid jobs never join a group, the jobs of the joined group are listed 
+// through the scheduler's "nextJobs" in job order, the order they spawn in,
+// which is the order of their numbers as a job may reuse an earlier index
+void join_groups(Runner* runner, JobTable* table, int index, int other) {
+    Intake* intake = runner->intake;
+    int* nextJobs = runner->scheduler->nextJobs;
+
+    if (other == -1 || 
+            is_invalid_job(intake->invalidJobs, table->jobs[other].number)) {
+        return;
+    }
+
+    int root = find_root(intake->parents, index);
+    int otherRoot = find_root(intake->parents, other);
+    if (root == otherRoot) {
+        return;
+    }
+
+    int i = intake->heads[root], j = intake->heads[otherRoot];
+    int first = -1, last = -1;
+    while (i != -1 || j != -1) {
+        int next = j;
+
+        if (j == -1 || (i != -1 && 
+                table->jobs[i].number < table->jobs[j].number)) {
+            next = i;
+            i = nextJobs[i];
+        } else {
+            j = nextJobs[j];
+        }
+
+        if (last == -1) {
+            first = next;
+        } else {
+            nextJobs[last] = next;
+        }
+        last = next;
+    }
+
+    intake->parents[otherRoot] = root;
+    intake->heads[root] = first;
+}
+
+// makes a unit of a group of jobs from the stream whose pipes are complete
+// the unit is queued, skipped or left waiting for its dependencies, which 
+// must be earlier jobs already in a unit so the dependencies can never form
+// a cycle, otherwise each job of the unit is made invalid
+// a unit left by a job of a sweep is reused if there is one, and a 
+// dependency on a job which has left the job table is found in the intake's
+// "failedJobs"
+void form_unit(Runner* runner, JobTable* table, int first) {
+    char* invDepMsg = "Invalid dependency for job";
+    Scheduler* scheduler = runner->scheduler;
+    Intake* intake = runner->intake;
+    int unit, broken = 0, failed = 0, waiting = 0;
+
+    // a skipped unit is kept until the jobs it waited on exit, so there can
+    // be more units than jobs in the table
+    if (scheduler->spareUnitCount > 0) {
+        unit = scheduler->spareUnits[--scheduler->spareUnitCount];
+    } else {
+        grow_runner(runner, scheduler->unitCount + 1);
+        unit = scheduler->unitCount++;
+    }
+    scheduler->firsts[unit] = first;
+    scheduler->sizes[unit] = 0;
+    scheduler->incoming[unit] = 0;
+    for (int i = first; i != -1; i = scheduler->nextJobs[i]) {
+        scheduler->unitOf[i] = unit;
+        scheduler->sizes[unit]++;
+    }
+
+    // dependencies are checked first, then an edge is added for each one 
+    // which has not exited yet
+    for (int pass = 0; pass < 2 && !broken && !failed; pass++) {
+        for (int i = first; i != -1; i = scheduler->nextJobs[i]) {
+            char* list = table->jobs[i].after;
+            int number;
+
+            while (list != NULL && (number = next_dependency(&list)) != 0) {
+                int dep = find_job(runner, number);
+
+                if (dep == -1 && number <= table->numbers && 
+                        !is_invalid_job(intake->invalidJobs, number)) {
+                    failed |= is_invalid_job(&intake->failedJobs, number);
+                } else if (dep == -1 || scheduler->unitOf[dep] == -1 || 
+                        scheduler->unitOf[dep] == unit) {
+                    broken = 1;
+                } else if (table->jobs[dep].result == 0) {
+                    failed = 1;
+                } else if (table->jobs[dep].result == -1 && pass == 1) {
+                    add_edge(scheduler, dep, unit);
+                    waiting++;
                 }
             }
+        }
+    }
+
+    for (int i = first; i != -1; ) {
+        int next = scheduler->nextJobs[i];
+
+        if (broken) {
+            fprintf(stderr, "%s %d\n", invDepMsg, table->jobs[i].number);
+            add_invalid_job(intake->invalidJobs, table->jobs[i].number);
+            scheduler->unitOf[i] = -1;
+            retire_job(runner, table, i);
+        } else {
+            runner->states.states[i] = JOB_QUEUED;
+            runner->states.queued++;
+        }
+        i = next;
+    }
 
-            if (!pass) {
-                int verLen = strlen(line) + 1;
-                char* verLine = (char*)malloc(verLen * sizeof(char));
-                strcpy(verLine, line);
-                lineSplit = split_by_commas(line);
+    if (broken) {
+        scheduler->spareUnits[scheduler->spareUnitCount++] = unit;
+    } else if (failed) {
+        scheduler->waiting[unit] = -1;
+        skip_unit(runner, table, unit, 0);
+    } else {
+        scheduler->waiting[unit] = waiting;
+        if (waiting == 0) {
+            queue_unit(runner, unit);
+        }
+    }
+}
 
-                for (int i = 0; i < verLen; i++) {
-                    if (verLine[i] == ',') {
-                        verLine[i] = ':';
-                    }
-                }
+// finds the index of a job in the job table from its number, for the 
+// after= lists of jobs admitted by the intake
+// returns -1 if there is no such job or it has left the job table
+int find_job(Runner* runner, int number) {
+    Intake* intake = runner->intake;
 
-                int time = 0, count = 0;
-                for (int i = 0; lineSplit[i] != NULL; i++) {
-                    if (i == 3) {
-                        time = check_timeout(lineSplit);
-                    }
-                    count = i;
-                }
+    if (number <= intake->base) {
+        return number - 1;
+    }
+    return find_pid(&intake->jobMap, number, 0);
+}
 
-                timeouts->times[*(timeCount) - (*invalidCount) - 1] = time;
-                if (verbose) {
-                    verLine = insert_time(verLine, time, count);
-                    fprintf(stderr, "%d:%s\n", *timeCount, verLine);
-                    fflush(stderr);
-                }
+// takes a job of a sweep out of the job table once it has finished or been 
+// made invalid, so that a sweep of any size only holds its jobs in flight
+// its trace is written and its usage added to the table's totals, then its
+// line is freed and its index left for add_job() to reuse, and its unit 
+// for form_unit() once no edge leads to the unit
+// does nothing for any other job, or a job of a sweep which uses a pipe
+void retire_job(Runner* runner, JobTable* table, int index) {
+    Scheduler* scheduler = runner->scheduler;
+    Intake* intake = runner->intake;
+    Job* job = &table->jobs[index];
+    int unit = scheduler->unitOf[index];
+
+    if (!job->sweep || job->inPipe != -1 || job->outPipe != -1) {
+        return;
+    }
 
-                free(lineSplit);
-                free(verLine);
-            }
-            (*timeCount)++;
+    if (runner->trace != NULL) {
+        write_job_trace(runner->trace, job, index);
+        for (int i = 0; i < TRACE_TYPES; i++) {
+            runner->trace->times[index * TRACE_TYPES + i] = -1;
+        }
+    }
+    add_usage(&table->retired, job);
+    if (job->result == 0) {
+        add_invalid_job(&intake->failedJobs, job->number);
+    }
+    find_pid(&intake->jobMap, job->number, 1);
+
+    free(job->line);
+    free(job->argv);
+    job->line = NULL;
+    job->argv = NULL;
+    table->spares[table->spareCount++] = index;
+
+    if (unit != -1) {
+        scheduler->firsts[unit] = -1;
+        scheduler->unitOf[index] = -1;
+        if (scheduler->incoming[unit] == 0) {
+            scheduler->spareUnits[scheduler->spareUnitCount++] = unit;
         }
-        free(line);
     }
-    fclose(file);
 }
 
-// inserts timeout value to job table for verbose mode
-// taked the line and the corresponding timeout value as parameters
-// returns an potentially reallocated char pointer for the line
-char* insert_time(char* line, int time, int index) {
-    int len = strlen(line) + 1, count = 0;
+// stops reading the streamed jobfile at its end or after a sighup
+// jobs in groups which are still missing an end of a pipe can never run, so
+// each such pipe is reported and every job not in a unit is made invalid
+void close_intake(Runner* runner, JobTable* table, PipeTable* pipes) {
+    char* invPipeMsg1 = "Invalid pipe usage \"";
+    char* invPipeMsg2 = "\"";
+    Intake* intake = runner->intake;
 
-    if (line[len - 1] != ':' && index < 3) {
-        line = (char*)realloc(line, (len + 1) * sizeof(char));
-        strcat(line, ":");
-        len++;
+    // stdin is left open, so no pipe created later can take its place
+    epoll_ctl(runner->epollFd, EPOLL_CTL_DEL, intake->fd, NULL);
+    if (intake->fd != STDIN_FILENO) {
+        close(intake->fd);
     }
+    intake->fd = -1;
+    end_sweep(&intake->sweep);
 
-    for (int i = 1; i < len; i++) {
-        if ((line[i] == line[i - 1] && line[i] == ':') || 
-                (line[i] == '\0' && line[i - 1] == ':')) {
-            count = i;
-            break;
+    for (int i = 0; i < pipes->count; i++) {
+        Pipe* pipe = &pipes->pipes[i];
+
+        if (pipe->writer == -1 || pipe->reader == -1) {
+            fprintf(stderr, "%s%s%s\n", invPipeMsg1, pipe->name + 1, 
+                    invPipeMsg2);
         }
     }
 
-    if (!count) {
-        return line;
+    for (int i = 0; i < table->count; i++) {
+        if (runner->scheduler->unitOf[i] == -1 && 
+                table->jobs[i].line != NULL) {
+            add_invalid_job(intake->invalidJobs, table->jobs[i].number);
+        }
+    }
+}
 
-    } else {
-        char* temp = (char*)malloc((len + 1) * sizeof(char));
-        strncpy(temp, line, count);
+// grows every array indexed by job or unit to hold at least "count" jobs
+// or units as jobs are read from the stream while others run
+void grow_runner(Runner* runner, int count) {
 
-        temp[count] = time + '0';
-        strcpy(temp + count + 1, line + count);
+    if (count <= runner->size) {
+        return;
+    }
 
-        line = (char*)realloc(line, (len + 1) * sizeof(char));
-        strcpy(line, temp);
+    int size = runner->size ? 2 * runner->size : 16;
+    while (size < count) {
+        size *= 2;
+    }
 
-        free(temp);
+    Scheduler* scheduler = runner->scheduler;
+    int** arrays[] = {&scheduler->firsts, &scheduler->sizes, 
+            &scheduler->nextJobs, &scheduler->unitOf, &scheduler->waiting, 
+            &scheduler->depHeads, &scheduler->depTails, &scheduler->ready, 
+            &scheduler->skipped, &scheduler->incoming, 
+            &scheduler->spareUnits, &runner->states.states, 
+            &runner->states.runningJobs, &runner->states.slots, 
+            &runner->intake->parents, &runner->intake->heads};
+
+    for (int i = 0; i < (int)(sizeof(arrays) / sizeof(arrays[0])); i++) {
+        *arrays[i] = (int*)realloc(*arrays[i], size * sizeof(int));
     }
-    return line;
+    if (runner->captures != NULL) {
+        runner->captures = (Capture*)realloc(runner->captures, 
+                size * sizeof(Capture));
+    }
+    grow_pid_map(&runner->pidMap, size);
+    grow_pid_map(&runner->intake->jobMap, size);
+    runner->size = size;
 }
 
-// checks for no jobs specified by the job files
-// takes the number of jobs named "count" as a parameter
-// exits with status 4 there are no jobs
-void check_jobs(int count) {
-    char* noJobsMsg = "jobrunner: no runnable jobs";
+// creates an empty hash table from job pids to their index in the job table
+// uses open addressing with at least twice as many slots as jobs
+void create_pid_map(PidMap* pidMap, int jobCount) {
+    pidMap->size = 1;
+    pidMap->count = 0;
+    pidMap->used = 0;
+    while (pidMap->size < 2 * jobCount) {
+        pidMap->size *= 2;
+    }
 
-    if (!(count > 0)) {
-        fprintf(stderr, "%s\n", noJobsMsg);
-        exit(4);
+    pidMap->pids = (pid_t*)malloc(pidMap->size * sizeof(pid_t));
+    pidMap->indices = (int*)malloc(pidMap->size * sizeof(int));
+    for (int i = 0; i < pidMap->size; i++) {
+        pidMap->pids[i] = PID_EMPTY;
     }
 }
 
-// creates pipes for child processes
-// takes number of pipes, "Pipe*" struct, number of jobs as parameters
-// also takes a 2D int arr of pipe file descriptors as a parameter
-void create_pipes(int validPipes, FdPipes* fdPipes) {
-    for (int i = 0; i < validPipes; i++) {
+// adds the pid of a newly launched job to the pid map
+// the PID_REMOVED slots of reaped jobs are dropped by moving the map once 
+// fewer than a quarter of its slots are empty, as indices reused by a sweep
+// would otherwise fill it with them however large it is
+void add_pid(PidMap* pidMap, pid_t pid, int index) {
+    if (4 * (pidMap->used + 1) > 3 * pidMap->size) {
+        grow_pid_map(pidMap, pidMap->count + 1);
+    }
 
-        if (pipe(fdPipes->fd[i]) == -1) {
-            fprintf(stderr, "pipe error\n");
-        }
+    int slot = pid & (pidMap->size - 1);
+    while (pidMap->pids[slot] != PID_EMPTY) {
+        slot = (slot + 1) & (pidMap->size - 1);
+    }
+    pidMap->pids[slot] = pid;
+    pidMap->indices[slot] = index;
+    pidMap->count++;
+    pidMap->used++;
+}
 
+// finds the index of a job in the job table from its pid
+// the job is removed from the pid map if "remove" is 1
+// returns -1 if the pid does not belong to a running job
+int find_pid(PidMap* pidMap, pid_t pid, int remove) {
+    int slot = pid & (pidMap->size - 1);
+
+    while (pidMap->pids[slot] != PID_EMPTY) {
+        if (pidMap->pids[slot] == pid) {
+            if (remove) {
+                pidMap->pids[slot] = PID_REMOVED;
+                pidMap->count--;
+            }
+            return pidMap->indices[slot];
+        }
+        slot = (slot + 1) & (pidMap->size - 1);
     }
+    return -1;
 }
 
-// reassigns the pipe numbers, disregards invalid pipes
-// takes an array of Pipe data structs and total number of pipes as parameters
-void reassign_pipe_numbers(Pipe* pipes, int* pipeCount) {
-    int count = 0;
-    for (int i = 0; i < *pipeCount - 1; i++) {
+// moves the pid map into a table for "jobCount" jobs
+// the PID_REMOVED slots of reaped jobs are dropped on the way
+void grow_pid_map(PidMap* pidMap, int jobCount) {
+    PidMap old = *pidMap;
 
-        if (pipes[i].error) {
-            pipes[i].number = -1;
-        } else {
-            pipes[i].number = count;
-            count++;
+    create_pid_map(pidMap, jobCount);
+    for (int i = 0; i < old.size; i++) {
+        if (old.pids[i] >= 0) {
+            add_pid(pidMap, old.pids[i], old.indices[i]);
         }
+    }
+    free(old.pids);
+    free(old.indices);
+}
+
+// gets the current CLOCK_MONOTONIC time in milliseconds
+// unlike time(NULL) this is not affected by changes to the system clock
+long long current_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// gets the current CLOCK_MONOTONIC time in microseconds for -trace
+long long current_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// grows the trace to hold the events of at least "count" jobs
+// with -stream or a sweep jobs are added from the event loop while others 
+// run, so the trace grows to TRACE_CHUNK jobs at once and then doubles, 
+// leaving it to reallocate only rarely there
+void grow_trace(Trace* trace, int count) {
+    int size = trace->size ? 2 * trace->size : TRACE_CHUNK;
+    count = count > size ? count : size;
+
+    trace->times = (long long*)realloc(trace->times, 
+            count * TRACE_TYPES * sizeof(long long));
+
+    for (int i = trace->size * TRACE_TYPES; i < count * TRACE_TYPES; i++) {
+        trace->times[i] = -1;
+    }
+    trace->size = count;
+}
 
+// records the time at which an event happened to a job
+// does nothing if "trace" is NULL
+void trace_event(Trace* trace, int job, int type) {
+    if (trace != NULL) {
+        trace->times[job * TRACE_TYPES + type] = current_us() - trace->origin;
     }
 }
 
-// calls helper functions to set up pipes before processes are created
-int* setup_processes(int execCount, int* validPipes, FdPipes* fdPipes, 
-        Pipe* pipes, int* pipeCount, int count, int argc, char** argv, 
-        int* jobNumber, InvalidJobs* invalidJobs, pid_t* pids, 
-        Timeouts* timeouts, time_t* times, int* validJobNumbers, 
-        int* execNumber, int* execFail) {
+// starts the trace, which is written as Chrome trace event JSON that 
+// Perfetto also reads
+void start_trace(Trace* trace) {
+    fprintf(trace->file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(trace->file, "{\"name\": \"process_name\", \"ph\": \"M\", "
+            "\"pid\": 1, \"args\": {\"name\": \"jobrunner\"}}");
+}
 
-    if (execCount > 0) {
-        create_pipes(*validPipes, fdPipes);
-        reassign_pipe_numbers(pipes, pipeCount);
+// writes the rest of the trace once every job has finished
+// each job still in the job table is written as by write_job_trace(), and 
+// each pipe has a flow arrow from its writer to each of its readers
+void write_trace(Trace* trace, JobTable* table, PipeTable* pipes) {
+    FILE* file = trace->file;
 
-        for (int i = count; i < argc; i++) {
+    for (int i = 0; i < table->count; i++) {
+        if (table->jobs[i].line != NULL) {
+            write_job_trace(trace, &table->jobs[i], i);
+        }
+    }
 
-            validJobNumbers = create_process(argv[i], pipes, fdPipes, 
-                    pipeCount, validPipes, jobNumber, invalidJobs, pids, 
-                    timeouts, times, validJobNumbers, execNumber, execFail);
+    for (int i = 0; i < pipes->count; i++) {
+        Pipe* pipe = &pipes->pipes[i];
+        int writer = pipe->writer;
 
-            if (*execFail) {
-                break;
+        if (writer == -1 || 
+                trace->times[writer * TRACE_TYPES + TRACE_REAPED] == -1) {
+            continue;
+        }
+
+        for (int j = pipe->reader; j != -1; j = table->jobs[j].nextReader) {
+            long long* times = trace->times + j * TRACE_TYPES;
+            if (times[TRACE_REAPED] == -1) {
+                continue;
             }
+
+            fprintf(file, ",\n{\"name\": ");
+            fprintf(file, "\"@");
+            write_json(file, pipe->name + 1);
+            fprintf(file, "\", \"cat\": \"pipe\", \"ph\": \"s\", "
+                    "\"id\": %d, \"pid\": 1, \"tid\": %d, \"ts\": %lld}", 
+                    j, table->jobs[writer].number, 
+                    trace->times[writer * TRACE_TYPES + TRACE_SPAWNED]);
+            fprintf(file, ",\n{\"name\": \"@");
+            write_json(file, pipe->name + 1);
+            fprintf(file, "\", \"cat\": \"pipe\", \"ph\": \"f\", "
+                    "\"bp\": \"e\", \"id\": %d, \"pid\": 1, \"tid\": %d, "
+                    "\"ts\": %lld}", j, table->jobs[j].number, 
+                    times[TRACE_SPAWNED]);
         }
     }
-    return validJobNumbers;
+    fprintf(file, "\n]}\n");
 }
 
-// creates a process to be executed
-// takes a file as "filename" to read a praameter
-// also takes the number of pipes and the array of "Pipe" data structs
-// calls the exec_job() function with executes a specified program
-int* create_process(char* filename, Pipe* pipes, FdPipes* fdPipes, 
-        int* pipeCount, int* validPipes, int* jobNumber, 
-        InvalidJobs* invalidJobs, pid_t* pids, Timeouts* timeouts, 
-        time_t* times, int* validJobNumbers, int* execNumber, int* execFail) {
+// writes the events of one job to the trace, when it leaves the job table 
+// or at the end
+// each job has its own track with slices for the time it waited for its 
+// dependencies and to be launched, was being spawned and ran, and instant 
+// events for its signals or being skipped
+void write_job_trace(Trace* trace, Job* job, int index) {
+    FILE* file = trace->file;
+    char* names[] = {"SIGABRT", "SIGKILL", "skipped"};
+    int instants[] = {TRACE_ABORTED, TRACE_KILLED, TRACE_SKIPPED};
+    long long* times = trace->times + index * TRACE_TYPES;
+
+    fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", "
+            "\"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", job->number);
+    fprintf(file, "\"Job %d ", job->number);
+    write_json(file, job->argv[0]);
+    fprintf(file, "\"}}");
+
+    long long launched = times[TRACE_SPAWN] != -1 ? times[TRACE_SPAWN] : 
+            times[TRACE_SKIPPED];
+    if (times[TRACE_QUEUED] != -1) {
+        write_slice(trace, job->number, "dependencies", 
+                times[TRACE_PARSED], times[TRACE_QUEUED]);
+        write_slice(trace, job->number, "queued", times[TRACE_QUEUED], 
+                launched);
+    } else {
+        write_slice(trace, job->number, 
+                times[TRACE_SKIPPED] != -1 ? "dependencies" : "queued", 
+                times[TRACE_PARSED], launched);
+    }
+    write_slice(trace, job->number, "spawn", times[TRACE_SPAWN], 
+            times[TRACE_SPAWNED]);
+    write_slice(trace, job->number, "running", times[TRACE_SPAWNED], 
+            times[TRACE_REAPED]);
+
+    for (int j = 0; j < 3; j++) {
+        if (times[instants[j]] != -1) {
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"i\", "
+                    "\"s\": \"t\", \"pid\": 1, \"tid\": %d, "
+                    "\"ts\": %lld}", names[j], job->number, 
+                    times[instants[j]]);
+        }
+    }
+}
 
-    FILE* file = fopen(filename, "r");
-    char* line;
-    char** lineSplit;
-    int invalidJob;
+// writes a complete event for a slice of a job's track to the trace
+// nothing is written unless both ends of the slice were recorded
+void write_slice(Trace* trace, int number, char* name, long long start, 
+        long long end) {
 
-    while ((line = read_line(file)) != NULL) {
-        invalidJob = 0;
+    if (start == -1 || end == -1) {
+        return;
+    }
+    fprintf(trace->file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+            "\"tid\": %d, \"ts\": %lld, \"dur\": %lld}", name, number, start, 
+            end - start);
+}
 
-        if (strlen(line) == 0 || isspace(line[0]) != 0) {
-            ;
-        } else if (line[0] != '#') {
+// writes text into a JSON string, escaping quotes, backslashes and control
+// characters
+void write_json(FILE* file, char* text) {
+    for (int i = 0; text[i] != '\0'; i++) {
+        unsigned char c = (unsigned char)text[i];
 
-            for (int i = 0; i < invalidJobs->invjobCount; i++) {
-                if (invalidJobs->invJobs[i] == (*jobNumber) + 1) {
-                    invalidJob = 1;
-                }
-            }
+        if (c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+}
 
-            if (invalidJob) {
-                (*jobNumber)++;
-                free(line);
-                continue;
-            }
+// adds a deadline for a job to the heap
+// takes the deadline in ms and the job's index in the job table and number
+void push_deadline(Deadlines* deadlines, long long time, int job, 
+        int number) {
+
+    if (deadlines->count == deadlines->size) {
+        grow_deadlines(deadlines);
+    }
 
-            lineSplit = split_by_commas(line);
-            times[*execNumber] = time(NULL);
-            pid_t id = fork();
+    int i = deadlines->count++;
+    while (i > 0 && deadlines->times[(i - 1) / 2] > time) {
+        deadlines->times[i] = deadlines->times[(i - 1) / 2];
+        deadlines->jobs[i] = deadlines->jobs[(i - 1) / 2];
+        deadlines->numbers[i] = deadlines->numbers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    deadlines->times[i] = time;
+    deadlines->jobs[i] = job;
+    deadlines->numbers[i] = number;
+}
 
-            if (id == -1) {
-                ;
-            } else if (id == 0) {
-                *execFail = exec_job(lineSplit, pipes, fdPipes, pipeCount,
-                        *validPipes);
-            }
+// doubles the room in the deadline heap
+void grow_deadlines(Deadlines* deadlines) {
+    deadlines->size *= 2;
+    deadlines->times = (long long*)realloc(deadlines->times, 
+            deadlines->size * sizeof(long long));
+    deadlines->jobs = (int*)realloc(deadlines->jobs, 
+            deadlines->size * sizeof(int));
+    deadlines->numbers = (int*)realloc(deadlines->numbers, 
+            deadlines->size * sizeof(int));
+}
+
+// drops the deadlines of jobs which have exited from the full heap, which 
+// otherwise keeps one for every job with a timeout until its time comes, 
+// and grows the heap if more than half of it is still needed
+// the deadlines kept are pushed again in place, as each one is read before 
+// the heap can grow over it
+void prune_deadlines(Runner* runner, JobTable* table) {
+    Deadlines* deadlines = &runner->deadlines;
+    int count = deadlines->count;
+
+    deadlines->count = 0;
+    for (int i = 0; i < count; i++) {
+        long long time = deadlines->times[i];
+        int job = deadlines->jobs[i], number = deadlines->numbers[i];
+        int state = runner->states.states[job];
+
+        if (table->jobs[job].number == number && 
+                (state == JOB_RUNNING || state == JOB_ABORTED)) {
+            push_deadline(deadlines, time, job, number);
+        }
+    }
 
-            free(lineSplit);
-            pids[*execNumber] = id;
-            validJobNumbers = (int*)realloc(validJobNumbers, 
-                    (*execNumber + 1) * sizeof(int));
+    if (2 * deadlines->count > deadlines->size) {
+        grow_deadlines(deadlines);
+    }
+}
 
-            validJobNumbers[*execNumber] = *jobNumber + 1;
-            (*jobNumber)++;
-            (*execNumber)++;
+// removes the earliest deadline from the heap
+void pop_deadline(Deadlines* deadlines) {
+    long long time = deadlines->times[--deadlines->count];
+    int job = deadlines->jobs[deadlines->count];
+    int number = deadlines->numbers[deadlines->count];
+    int i = 0;
+
+    while (2 * i + 1 < deadlines->count) {
+        int child = 2 * i + 1;
+        if (child + 1 < deadlines->count && 
+                deadlines->times[child + 1] < deadlines->times[child]) {
+            child++;
         }
-        free(line);
-        if (*execFail) {
+        if (time <= deadlines->times[child]) {
             break;
         }
+        deadlines->times[i] = deadlines->times[child];
+        deadlines->jobs[i] = deadlines->jobs[child];
+        deadlines->numbers[i] = deadlines->numbers[child];
+        i = child;
     }
-    fclose(file);
-    return validJobNumbers;
+    deadlines->times[i] = time;
+    deadlines->jobs[i] = job;
+    deadlines->numbers[i] = number;
 }
 
-// waits for all child processes using paitpid()
-// takes number of jobs, InvalidJobs data struct and pids array as parameters
-void wait_for_process(pid_t* pids, Timeouts* timeouts, int execCount, 
-        int* validJobNumbers, time_t* times, FdPipes* fdPipes, 
-        int validPipes) {
+// arms the timerfd to expire at the earliest deadline in the heap
+// disarms the timerfd if there are no deadlines left
+void arm_timer(int timerFd, Deadlines* deadlines) {
+    struct itimerspec timer;
+    memset(&timer, 0, sizeof(timer));
 
-    prepare_for_wait(fdPipes, validPipes);
-    int count = 0;
-    int* completedJobs = (int*)malloc(execCount * sizeof(int));
+    if (deadlines->count > 0) {
+        long long time = deadlines->times[0];
+        timer.it_value.tv_sec = time / 1000;
+        timer.it_value.tv_nsec = (time % 1000) * 1000000;
+    }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
 
-    while (1) {
-        for (int i = 0; i < execCount; i++) {
-            int status, aborted = 0, skip = 0, completed = 0;
-            time_t start = time(NULL);
-
-            for (int j = 0; j < count; j++) {
-                if (completedJobs[j] == i) {
-                    completed = 1;
-                    break;
-                }
-            }
+// signals every job whose deadline has passed then rearms the timerfd
+// a running job that has timed out is sent SIGABRT and given a new deadline
+// "grace" ms later, an aborted job still running at that deadline is sent 
+// SIGKILL, deadlines of jobs that have already exited are discarded, 
+// including those whose index now belongs to a later job
+void check_timeouts(Runner* runner, JobTable* table) {
+    Deadlines* deadlines = &runner->deadlines;
+    JobStates* states = &runner->states;
+    long long now = current_ms();
+
+    while (deadlines->count > 0 && deadlines->times[0] <= now) {
+        int job = deadlines->jobs[0], number = deadlines->numbers[0];
+        pop_deadline(deadlines);
+
+        if (table->jobs[job].number != number) {
+            continue;
+        } else if (states->states[job] == JOB_RUNNING) {
+            kill(table->jobs[job].pid, SIGABRT);
+            states->states[job] = JOB_ABORTED;
+            push_deadline(deadlines, now + runner->grace, job, number);
+            trace_event(runner->trace, job, TRACE_ABORTED);
+
+        } else if (states->states[job] == JOB_ABORTED) {
+            kill(table->jobs[job].pid, SIGKILL);
+            states->states[job] = JOB_KILLED;
+            trace_event(runner->trace, job, TRACE_KILLED);
+        }
+    }
+    arm_timer(runner->timerFd, deadlines);
+}
 
-            if (completed) {
-                continue;
-            }
+// reads all pending signals from the signalfd
+// sets the sighup flag if a SIGHUP was received
+// returns 1 if a SIGUSR1 asked for the status of the jobs, else returns 0
+int read_signals(int sigFd) {
+    struct signalfd_siginfo info;
+    int status = 0;
+
+    while (read(sigFd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGHUP) {
+            sighup = 1;
+        } else if (info.ssi_signo == SIGUSR1) {
+            status = 1;
+        }
+    }
+    return status;
+}
 
-            while (waitpid(pids[i], &status, WNOHANG) != -1) {
+// adds a job which has been spawned to the list of running jobs
+void add_running(JobStates* states, int job) {
+    states->slots[job] = states->running;
+    states->runningJobs[states->running++] = job;
+}
 
-                if (sighup) {
-                    for (int j = 0; j < execCount; j++) {
-                        kill(pids[j], SIGKILL);
-                    }
-                }
+// removes a job which has been reaped from the list of running jobs, moving
+// the last running job into its place
+void remove_running(JobStates* states, int job) {
+    int last = states->runningJobs[--states->running];
 
-                double elapsed = difftime(time(NULL), times[i]);
-                if (elapsed > timeouts->times[i] && timeouts->times[i] != 0) {
-                    kill(pids[i], SIGABRT);
-                    if (aborted) {
-                        kill(pids[i], SIGKILL);
-                    }
-                    sleep(1);
-                    aborted = 1;
-                }
+    states->runningJobs[states->slots[job]] = last;
+    states->slots[last] = states->slots[job];
+}
 
-                if (aborted) {
-                    ;
-                } else if (difftime(time(NULL), start) > 0.01) {
-                    skip = 1;
-                    break;
-                }
-            }
+// prints the number of jobs in each state to stderr, then each running job
+// with how long it has run and how long until it is next signalled
+// only the running jobs are visited, so this is cheap however many jobs 
+// there are
+void print_status(Runner* runner, JobTable* table) {
+    JobStates* states = &runner->states;
+    long long now = current_ms();
+
+    fprintf(stderr, "Status: %d running, %d queued, %d succeeded, "
+            "%d failed, %d skipped%s\n", states->running, states->queued, 
+            states->succeeded, states->failed, states->skipped, 
+            runner->throttled ? ", launches paused" : "");
+
+    for (int i = 0; i < states->running; i++) {
+        int index = states->runningJobs[i];
+        Job* job = &table->jobs[index];
+        long long deadline = job->start + job->timeout;
+
+        fprintf(stderr, "Job %d running for %lldms", job->number, 
+                now - job->start);
+        if (states->states[index] == JOB_KILLED) {
+            fprintf(stderr, ", killed\n");
+        } else if (states->states[index] == JOB_ABORTED) {
+            fprintf(stderr, ", timed out, killed in %lldms\n", 
+                    deadline + runner->grace - now);
+        } else if (job->timeout != 0) {
+            fprintf(stderr, ", timeout in %lldms\n", deadline - now);
+        } else {
+            fprintf(stderr, "\n");
+        }
+    }
+}
 
-            if (skip) {
-                continue;
+// reaps every child that has exited and prints its exit status
+// each child is found in the pid map, so each exit costs O(1)
+// any output captured from the child is written out before its status
+// the resources used by each child are recorded and printed if -stats is set
+void reap_children(Runner* runner, JobTable* table) {
+    JobStates* states = &runner->states;
+    struct rusage rusage;
+    pid_t pid;
+    int status;
+
+    while ((pid = wait4(-1, &status, WNOHANG, &rusage)) > 0) {
+        int index = find_pid(&runner->pidMap, pid, 1);
+
+        if (index == -1 || states->states[index] == JOB_DONE) {
+            continue;
+        }
+
+        if (runner->captures != NULL) {
+            drain_capture(runner, table, index);
+        }
+        if (table->jobs[index].cpu != -1) {
+            runner->coreJobs[table->jobs[index].cpu]--;
+        }
+        record_usage(&table->jobs[index], &rusage);
+        trace_event(runner->trace, index, TRACE_REAPED);
+        int oomKilled = 0;
+        if (uses_cgroup(runner, &table->jobs[index])) {
+            oomKilled = close_cgroup(runner, &table->jobs[index]);
+        }
+        exit_status(table->jobs[index].number, status, oomKilled);
+        if (runner->stats) {
+            print_usage(&table->jobs[index]);
+        }
+        if (table->jobs[index].hash != 0 && WIFEXITED(status)) {
+            store_cache(runner, &table->jobs[index], WEXITSTATUS(status));
+        }
+        states->states[index] = JOB_DONE;
+        remove_running(states, index);
+        finish_job(runner, table, index, 
+                WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+}
+
+// updates the units depending on a job which has finished
+// a unit is queued once all of its dependencies have succeeded, if this job
+// did not succeed every unit depending on it is skipped
+// units to skip are kept on a stack rather than recursing, so a long chain 
+// of skipped units can not overflow the call stack
+void finish_job(Runner* runner, JobTable* table, int job, int success) {
+    Scheduler* scheduler = runner->scheduler;
+    int count = 0;
+
+    table->jobs[job].result = success;
+    if (success) {
+        runner->states.succeeded++;
+    } else {
+        runner->states.failed++;
+    }
+    for (int i = scheduler->depHeads[job]; i != -1; 
+            i = scheduler->depNexts[i]) {
+        int unit = scheduler->depUnits[i];
+
+        if (unit == -1 || scheduler->waiting[unit] == -1) {
+            continue;
+        } else if (!success) {
+            scheduler->waiting[unit] = -1;
+            scheduler->skipped[count++] = unit;
+        } else if (--scheduler->waiting[unit] == 0) {
+            queue_unit(runner, unit);
+
+            for (int j = scheduler->firsts[unit]; j != -1 && 
+                    runner->trace != NULL; j = scheduler->nextJobs[j]) {
+                trace_event(runner->trace, j, TRACE_QUEUED);
             }
-            exit_status(validJobNumbers, i, status, completedJobs, &count);
         }
+    }
 
-        if (count == execCount) {
-            break;
+    free_edges(scheduler, job);
+    retire_job(runner, table, job);
+
+    while (count > 0) {
+        count--;
+        count = skip_unit(runner, table, scheduler->skipped[count], count);
+    }
+}
+
+// skips every job in a unit whose dependency did not succeed
+// prints a message for each job and pushes the units depending on them onto
+// the stack of skipped units, which holds "count" units
+// returns the new number of units on the stack
+int skip_unit(Runner* runner, JobTable* table, int unit, int count) {
+    Scheduler* scheduler = runner->scheduler;
+
+    for (int i = scheduler->firsts[unit]; i != -1; 
+            i = scheduler->nextJobs[i]) {
+        fprintf(stderr, "Job %d skipped\n", table->jobs[i].number);
+        if (runner->states.states[i] == JOB_QUEUED) {
+            runner->states.queued--;
+        }
+        runner->states.skipped++;
+        runner->states.states[i] = JOB_DONE;
+        table->jobs[i].result = 0;
+        trace_event(runner->trace, i, TRACE_SKIPPED);
+
+        for (int j = scheduler->depHeads[i]; j != -1; 
+                j = scheduler->depNexts[j]) {
+            int next = scheduler->depUnits[j];
+
+            if (next != -1 && scheduler->waiting[next] != -1) {
+                scheduler->waiting[next] = -1;
+                scheduler->skipped[count++] = next;
+            }
         }
+        free_edges(scheduler, i);
+        retire_job(runner, table, i);
     }
-    free(completedJobs);
+    return count;
 }
 
 // prepares for wait pid by flushing stdout and stderr
-// closes all pipe file descriptors in the parent process
-void prepare_for_wait(FdPipes* fdPipes, int validPipes) {
+// so that no buffered output is copied into the child processes
+void prepare_for_wait(void) {
     fflush(stdout);
     fflush(stderr);
-    close_pipe_fds(fdPipes, validPipes);
-    sleep(1);
 }
 
 // prints the exit status information of finished jobs to stderr
-// takes the array of valid jobs, index for that array and status as parameters
-void exit_status(int* validJobNumbers, int index, int status, 
-        int* completedJobs, int* count) {
+// takes the job number and its status as parameters, and whether the OOM 
+// killer killed a process in its cgroup
+void exit_status(int number, int status, int oomKilled) {
 
     if (WIFEXITED(status)) {
         int exitStatus = WEXITSTATUS(status);
-        fprintf(stderr, "Job %d exited with status %d\n", 
-                validJobNumbers[index], exitStatus);
+        fprintf(stderr, "Job %d exited with status %d\n", number, 
+                exitStatus);
+
+    } else if (WIFSIGNALED(status) && oomKilled) {
+        fprintf(stderr, "Job %d killed by the OOM killer at its memory "
+                "limit\n", number);
 
     } else if (WIFSIGNALED(status)) {
         int termStatus = WTERMSIG(status);
-        fprintf(stderr, "Job %d terminated with signal %d\n", 
-                validJobNumbers[index], termStatus);
+        fprintf(stderr, "Job %d terminated with signal %d\n", number, 
+                termStatus);
     }
+}
 
-    completedJobs[*count] = index;
-    (*count)++;
+// records the wall time of a job that has exited and the resources it used
+// takes the job and the rusage returned by wait4() for it
+void record_usage(Job* job, struct rusage* rusage) {
+    Usage* usage = &job->usage;
+
+    usage->wall = current_ms() - job->start;
+    usage->user = rusage->ru_utime.tv_sec * 1000LL + 
+            rusage->ru_utime.tv_usec / 1000;
+    usage->system = rusage->ru_stime.tv_sec * 1000LL + 
+            rusage->ru_stime.tv_usec / 1000;
+    usage->maxRss = rusage->ru_maxrss;
+    usage->voluntary = rusage->ru_nvcsw;
+    usage->involuntary = rusage->ru_nivcsw;
 }
 
-// executes a program specified in the job files
-// takes a line from a jobfile as a parameter
-// calls the execvp() function to execute a specified program
-int exec_job(char** line, Pipe* pipes, FdPipes* fdPipes, int* pipeCount, 
-        int validPipes) {
-    int argCount = 0, execFail = 0;
-    char** args = (char**)malloc(0);
+// prints the resources used by a job to stderr
+void print_usage(Job* job) {
+    Usage* usage = &job->usage;
 
-    for (int i = 0; line[i] != NULL; i++) {
-        if (i == 0 || i > 3) {
-            args = (char**)realloc(args, (argCount + 1) * sizeof(char*));
+    fprintf(stderr, "Job %d used %lldms wall %lldms user %lldms system "
+            "%ldKB rss %ld+%ld switches\n", job->number, usage->wall, 
+            usage->user, usage->system, usage->maxRss, usage->voluntary, 
+            usage->involuntary);
+}
 
-            int count;
-            for (count = 1; line[i][count - 1] != '\0'; count++) {
-                ;
-            }
+// prints the total resources used by every job that was reaped and the 
+// makespan in ms, then the jobs which used the most cpu time and memory
+// jobs which have left the job table are already in its "retired" totals
+// the buffer sizes the kernel gave any resized pipes are printed last
+void print_summary(JobTable* table, PipeTable* pipes, long long makespan) {
+    Totals totals = table->retired;
 
-            args[argCount] = (char*)malloc(count * sizeof(char));
-            strcpy(args[argCount], line[i]);
-            argCount++;
+    for (int i = 0; i < table->count; i++) {
+        if (table->jobs[i].line != NULL) {
+            add_usage(&totals, &table->jobs[i]);
+        }
+    }
 
-        } else if (i == 1) {
+    fprintf(stderr, "Ran %d jobs in %lldms, %lldms user %lldms system\n", 
+            totals.count, makespan, totals.user, totals.system);
 
-            if (line[i][0] == '@') {
-                assign_pipes(line[i], pipes, fdPipes, pipeCount, i);
-            } else if (strcmp(line[i], "-") != 0) {
-                int fd0 = open(line[i], O_RDONLY);
-                dup2(fd0, 0);
-                close(fd0);
-            }
+    fprintf(stderr, "Most cpu:");
+    for (int i = 0; i < totals.cpuCount; i++) {
+        fprintf(stderr, " Job %d %lldms", totals.cpuJobs[i], 
+                totals.cpuTimes[i]);
+    }
+    fprintf(stderr, "\nMost rss:");
+    for (int i = 0; i < totals.rssCount; i++) {
+        fprintf(stderr, " Job %d %lldKB", totals.rssJobs[i], 
+                totals.rssSizes[i]);
+    }
+    fprintf(stderr, "\n");
 
-        } else if (i == 2) {
+    int resized = 0, smallest = 0, largest = 0;
+    for (int i = 0; i < pipes->count; i++) {
+        int size = pipes->pipes[i].size;
 
-            if (line[i][0] == '@') {
-                assign_pipes(line[i], pipes, fdPipes, pipeCount, i);
-            } else if (strcmp(line[i], "-") != 0) {
-                int fd1 = open(line[i], O_WRONLY | O_CREAT | O_TRUNC, 
-                        S_IRWXU | S_IRGRP);
-                dup2(fd1, 1);
-                close(fd1);
-            }
+        if (size > 0) {
+            smallest = resized == 0 || size < smallest ? size : smallest;
+            largest = size > largest ? size : largest;
+            resized++;
+        }
+    }
+    if (resized > 0) {
+        fprintf(stderr, "Pipe buffers: %d pipes resized, %d to %d bytes\n", 
+                resized, smallest, largest);
+    }
+}
+
+// adds the resources used by a job to the totals if it was reaped
+void add_usage(Totals* totals, Job* job) {
+    Usage* usage = &job->usage;
 
+    if (usage->wall == -1) {
+        return;
+    }
+
+    totals->count++;
+    totals->user += usage->user;
+    totals->system += usage->system;
+    insert_top(totals->cpuJobs, totals->cpuTimes, &totals->cpuCount, 
+            job->number, usage->user + usage->system);
+    insert_top(totals->rssJobs, totals->rssSizes, &totals->rssCount, 
+            job->number, usage->maxRss);
+}
+
+// inserts a job into a list of at most TOP_JOBS jobs with the largest keys
+// the list holds "count" jobs in descending order of their keys, jobs with 
+// equal keys are kept in order of their numbers, as the jobs of a sweep 
+// which have left the job table are added first
+void insert_top(int* jobs, long long* keys, int* count, int job, 
+        long long key) {
+
+    int i = *count < TOP_JOBS ? (*count)++ : TOP_JOBS;
+
+    while (i > 0 && (keys[i - 1] < key || 
+            (keys[i - 1] == key && jobs[i - 1] > job))) {
+        if (i < TOP_JOBS) {
+            jobs[i] = jobs[i - 1];
+            keys[i] = keys[i - 1];
         }
+        i--;
+    }
+
+    if (i < TOP_JOBS) {
+        jobs[i] = job;
+        keys[i] = key;
     }
+}
 
-    close_pipe_fds(fdPipes, validPipes);
-    args = (char**)realloc(args, (argCount + 1) * sizeof(char*));
-    args[argCount] = NULL;
+// executes a program specified in the job files
+// takes a job from the job table as a parameter, and its capture pipes (NULL 
+// if its output is not captured)
+// calls the execvp() function to execute the job, exits with status 255 if
+// the program could not be executed
+void exec_job(Job* job, PipeTable* pipes, Capture* capture) {
+
+    if (job->inPipe != -1) {
+        assign_pipes(job, pipes, 1);
+    } else if (strcmp(job->input, "-") != 0) {
+        int fd0 = open(job->input, O_RDONLY);
+        dup2(fd0, 0);
+        close(fd0);
+    }
 
-    int fdError = open("/dev/null", O_WRONLY);
-    dup2(fdError, 2);
-    close(fdError);
+    if (job->outPipe != -1) {
+        assign_pipes(job, pipes, 2);
+    } else if (strcmp(job->output, "-") != 0) {
+        int fd1 = open(job->output, O_WRONLY | O_CREAT | O_TRUNC, 
+                S_IRWXU | S_IRGRP);
+        dup2(fd1, 1);
+        close(fd1);
+    } else if (capture != NULL && capture->childFds[0] != -1) {
+        dup2(capture->childFds[0], 1);
+    }
 
-    if (execvp(args[0], args) == -1) {
-        execFail = 1;
+    if (capture != NULL && capture->childFds[1] != -1) {
+        dup2(capture->childFds[1], 2);
+    } else {
+        int fdError = open("/dev/null", O_WRONLY);
+        dup2(fdError, 2);
+        close(fdError);
     }
+    unblock_signals();
 
-    for (int i = 0; i < argCount; i++) {
-        free(args[i]);
+    if ((job->cgroupFd != -1 && write(job->cgroupFd, "0", 1) == -1) || 
+            set_scheduling(job) == -1 || set_limits(job) == -1) {
+        _exit(255);
     }
-    free(args);
 
-    if (execFail) {
-        return 255;
+    execvp(job->argv[0], job->argv);
+    _exit(255);
+}
+
+// checks if a job changes its cpus, nice value, I/O priority, limits or 
+// cgroup, which must be done in its child before it is executed
+// returns 1 if it does, else returns 0
+int needs_fork(Job* job) {
+    return job->cpus != NULL || job->cpu != -1 || job->nice != NICE_UNSET || 
+            job->ioprio != -1 || job->memLimit != 0 || job->fileLimit != 0 ||
+            job->cpuLimit != 0 || job->cgroupFd != -1;
+}
+
+// sets the cpus, nice value and I/O priority of a job in its child, just 
+// before it is executed
+// returns -1 if any of them could not be set, else returns 0
+int set_scheduling(Job* job) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (job->cpus != NULL) {
+        check_cpus(job->cpus, &set);
+    } else if (job->cpu != -1) {
+        CPU_SET(job->cpu, &set);
     }
 
+    if ((job->cpus != NULL || job->cpu != -1) && 
+            sched_setaffinity(0, sizeof(set), &set) == -1) {
+        return -1;
+    }
+    if (job->nice != NICE_UNSET && 
+            setpriority(PRIO_PROCESS, 0, job->nice) == -1) {
+        return -1;
+    }
+    if (job->ioprio != -1 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, 
+            job->ioprio) == -1) {
+        return -1;
+    }
     return 0;
 }
 
-// closes all pipe file dsescriptors
-// takes in the array of pipe file descriptors and the number of valid pipes
-void close_pipe_fds(FdPipes* fdPipes, int validPipes) {
-    for (int i = 0; i < validPipes; i++) {
-        close(fdPipes->fd[i][0]);
-        close(fdPipes->fd[i][1]);
+// sets the resource limits of a job in its child, just before it is 
+// executed
+// a job in a cgroup has its memory limited by memory.max instead, which 
+// counts the memory it uses rather than the address space it maps
+// the cpu time limit sends SIGXCPU, then SIGKILL a second later
+// returns -1 if any limit could not be set, else returns 0
+int set_limits(Job* job) {
+    struct rlimit limit;
+
+    if (job->memLimit != 0 && job->cgroupFd == -1) {
+        limit.rlim_cur = limit.rlim_max = job->memLimit;
+        if (setrlimit(RLIMIT_AS, &limit) == -1) {
+            return -1;
+        }
+    }
+    if (job->fileLimit != 0) {
+        limit.rlim_cur = limit.rlim_max = job->fileLimit;
+        if (setrlimit(RLIMIT_FSIZE, &limit) == -1) {
+            return -1;
+        }
+    }
+    if (job->cpuLimit != 0) {
+        limit.rlim_cur = job->cpuLimit;
+        limit.rlim_max = job->cpuLimit + 1;
+        if (setrlimit(RLIMIT_CPU, &limit) == -1) {
+            return -1;
+        }
     }
+    return 0;
 }
 
-// assigns pipe end to corresponding job stdin or stdout
-// takes tha array of Pipe data structs and pipe name as parameters
-// also takes the pipes file descriptors and the number of valid pipes
-void assign_pipes(char* name, Pipe* pipes, FdPipes* fdPipes, int* pipeCount, 
-        int index) {
+// makes the cgroup "jobrunner-PID" beside jobrunner's own for -cgroup, 
+// moves jobrunner into its leaf "supervisor" and enables the memory and cpu
+// controllers for its children, where each job's cgroup "job-N" is made
+// cgroup v2 only allows controllers on a cgroup without processes, so this
+// subtree leaves the cgroup jobrunner was started in and any other process 
+// in it untouched, but the controllers must already be enabled there
+// the subtree is removed again by remove_cgroup()
+// "cgroup" is left NULL and a message printed if cgroup v2 is not 
+// delegated to jobrunner, the jobs' limits are then set by set_limits()
+void setup_cgroup(Runner* runner) {
+    char line[PATH_MAX], dir[PATH_MAX + 16], path[PATH_MAX + 48];
+    FILE* file = fopen("/proc/self/cgroup", "r");
+    int found = 0;
+
+    while (file != NULL && !found && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(dir, sizeof(dir), "%s%s", CGROUP_ROOT, line + 3);
+            found = 1;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
 
-    for (int i = 0; i < (*pipeCount) - 1; i++) {
-        if (strcmp(name, pipes[i].name) == 0) {
+    // only a cgroup v2 directory lists its controllers
+    snprintf(path, sizeof(path), "%s/cgroup.controllers", dir);
+    if (!found || access(path, R_OK) != 0) {
+        fprintf(stderr, "jobrunner: cgroup v2 is not available\n");
+        return;
+    }
 
-            if (pipes[i].number == -1 || pipes[i].error == 1) {
-                ;
-            } else if (index == 1) {
-                dup2(fdPipes->fd[pipes[i].number][0], 0);
-            } else if (index == 2) {
-                dup2(fdPipes->fd[pipes[i].number][1], 1);
-            }
+    snprintf(path, sizeof(path), "%s/jobrunner-%d", dir, (int)getpid());
+    if (mkdir(path, 0755) == -1) {
+        fprintf(stderr, "jobrunner: cgroup v2 is not available\n");
+        return;
+    }
+    runner->cgroup = strdup(path);
+    runner->cgroupHome = strdup(dir);
+
+    strcat(path, "/supervisor");
+    if (mkdir(path, 0755) == -1 || 
+            write_cgroup(path, "cgroup.procs", "0") == -1 || 
+            write_cgroup(runner->cgroup, "cgroup.subtree_control", 
+            "+memory +cpu") == -1) {
+        fprintf(stderr, "jobrunner: cgroup v2 is not available\n");
+        remove_cgroup(runner, NULL);
+    }
+}
+
+// removes the subtree made by setup_cgroup() when jobrunner exits, whether
+// its jobs finished or were killed by SIGHUP
+// any job's cgroup that is left is removed, then jobrunner moves back to 
+// the cgroup it was started in so its leaf and the subtree can be removed
+// "table" may be NULL if no job's cgroup was made
+void remove_cgroup(Runner* runner, JobTable* table) {
+    char path[PATH_MAX + 64];
+
+    if (runner->cgroup == NULL) {
+        return;
+    }
 
+    for (int i = 0; table != NULL && i < table->count; i++) {
+        if (table->jobs[i].line != NULL && 
+                uses_cgroup(runner, &table->jobs[i])) {
+            cgroup_path(runner, &table->jobs[i], path, sizeof(path));
+            rmdir(path);
         }
     }
+
+    write_cgroup(runner->cgroupHome, "cgroup.procs", "0");
+    snprintf(path, sizeof(path), "%s/supervisor", runner->cgroup);
+    rmdir(path);
+    rmdir(runner->cgroup);
+
+    free(runner->cgroup);
+    free(runner->cgroupHome);
+    runner->cgroup = NULL;
+    runner->cgroupHome = NULL;
 }
 
-// frees all manually allocated memory
-void free_alloc_mem(int pipeCount, int validPipes, Pipe* pipes, 
-        FdPipes* fdPipes, pid_t* pids, InvalidJobs* invalidJobs, 
-        Timeouts* timeouts, time_t* times, int* validJobNumbers) {
+// writes text to a file in a cgroup directory
+// returns -1 if the file could not be written, else returns 0
+int write_cgroup(char* dir, char* name, char* text) {
+    char path[PATH_MAX + 64];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int result = write(fd, text, strlen(text)) == (ssize_t)strlen(text);
+    close(fd);
+    return result ? 0 : -1;
+}
+
+// checks if a job is given a cgroup of its own, which it is with -cgroup if
+// it has a memory or cpu rate limit
+// returns 1 if it is, else returns 0
+int uses_cgroup(Runner* runner, Job* job) {
+    return runner->cgroup != NULL && (job->memLimit != 0 || job->cpuRate != 0);
+}
+
+// gets the path of a job's cgroup, which is named after the job number 
+// inside jobrunner's subtree
+void cgroup_path(Runner* runner, Job* job, char* path, int size) {
+    snprintf(path, size, "%s/job-%d", runner->cgroup, job->number);
+}
+
+// creates a job's cgroup with its memory and cpu rate limits, and opens 
+// its cgroup.procs so the child can move itself in before it is executed
+// the job runs without a cgroup if it can not be created
+void open_cgroup(Runner* runner, Job* job) {
+    char path[PATH_MAX + 64], text[32];
+    cgroup_path(runner, job, path, sizeof(path));
+
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        return;
+    }
+
+    if (job->memLimit != 0) {
+        snprintf(text, sizeof(text), "%lld", job->memLimit);
+        write_cgroup(path, "memory.max", text);
+        write_cgroup(path, "memory.swap.max", "0");
+    }
+    if (job->cpuRate != 0) {
+        snprintf(text, sizeof(text), "%lld %d", 
+                (long long)job->cpuRate * CPU_PERIOD / 100, CPU_PERIOD);
+        write_cgroup(path, "cpu.max", text);
+    }
+
+    strcat(path, "/cgroup.procs");
+    job->cgroupFd = open(path, O_WRONLY | O_CLOEXEC);
+}
+
+// removes a job's cgroup once it has exited
+// returns 1 if the OOM killer killed a process in the cgroup, else returns 0
+int close_cgroup(Runner* runner, Job* job) {
+    char path[PATH_MAX + 64], line[64];
+    int kills = 0;
+    cgroup_path(runner, job, path, sizeof(path));
+
+    int length = strlen(path);
+    strcat(path, "/memory.events");
+    FILE* file = fopen(path, "r");
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        sscanf(line, "oom_kill %d", &kills);
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    path[length] = '\0';
+    rmdir(path);
+    return kills > 0;
+}
+
+// lists the cpus jobrunner may run on for -pin, jobs are only pinned to 
+// these so a cpu limit set by taskset or a cgroup is kept
+void find_cores(Runner* runner) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+
+    runner->cores = (int*)malloc(CPU_COUNT(&set) * sizeof(int));
+    runner->coreJobs = (int*)calloc(CPU_SETSIZE, sizeof(int));
+    runner->coreCount = 0;
+    runner->nextCore = 0;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            runner->cores[runner->coreCount++] = cpu;
+        }
+    }
+}
+
+// picks the cpu with the fewest running jobs pinned to it for -pin
+// cpus are tried in turn from the one after the last cpu picked, so jobs are 
+// spread round-robin while all cpus are equally busy
+// returns the cpu
+int pick_core(Runner* runner) {
+    int best = runner->nextCore;
+
+    for (int i = 1; i < runner->coreCount; i++) {
+        int next = (runner->nextCore + i) % runner->coreCount;
+
+        if (runner->coreJobs[runner->cores[next]] < 
+                runner->coreJobs[runner->cores[best]]) {
+            best = next;
+        }
+    }
+
+    runner->nextCore = (best + 1) % runner->coreCount;
+    return runner->cores[best];
+}
 
-    for (int i = 0; i < pipeCount - 1; i++) {
-        free(pipes[i].name);
+// closes both file descriptors of a pipe in the parent
+void close_pipe(Pipe* pipe) {
+    close(pipe->fd[0]);
+    close(pipe->fd[1]);
+    pipe->fd[0] = -1;
+    pipe->fd[1] = -1;
+}
+
+// assigns pipe end to corresponding job stdin or stdout
+// takes the job whose pipe ends are to be assigned as a parameter
+// index 1 assigns the read end to stdin, index 2 the write end to stdout
+void assign_pipes(Job* job, PipeTable* pipes, int index) {
+
+    int fd = find_pipe_fd(job, pipes, index);
+
+    if (fd != -1) {
+        dup2(fd, index - 1);
+    }
+}
+
+// finds the pipe end a job uses as its stdin (index 1) or stdout (index 2)
+// a reader of a pipe with several readers uses its own pipe from the relay
+// returns the file descriptor, or -1 if the pipe is invalid
+int find_pipe_fd(Job* job, PipeTable* pipes, int index) {
+
+    Pipe* pipe = &pipes->pipes[index == 1 ? job->inPipe : job->outPipe];
+
+    if (pipe->error == 1) {
+        return -1;
+    } else if (index == 1) {
+        return pipe->readerCount > 1 ? job->fanFd[0] : pipe->fd[0];
     }
+    return pipe->fd[1];
+}
+
+// frees all manually allocated memory
+// pipe names point into job lines so are not freed separately
+void free_alloc_mem(JobTable* table, PipeTable* pipes, 
+        InvalidJobs* invalidJobs, Scheduler* scheduler) {
 
-    free(pipes);
-    for (int i = 0; i < validPipes; i++) {
-        free(fdPipes->fd[i]);
+    for (int i = 0; i < table->count; i++) {
+        free(table->jobs[i].line);
+        free(table->jobs[i].argv);
     }
 
-    free(fdPipes->fd);
-    free(pids);
+    free(table->jobs);
+    free(table->spares);
+    free(pipes->pipes);
+    free(pipes->buckets);
     free(invalidJobs->invJobs);
-    free(timeouts->times);
-    free(times);
-    free(validJobNumbers);
-}
\ No newline at end of file
+
+    if (scheduler != NULL) {
+        free(scheduler->firsts);
+        free(scheduler->sizes);
+        free(scheduler->nextJobs);
+        free(scheduler->unitOf);
+        free(scheduler->waiting);
+        free(scheduler->depHeads);
+        free(scheduler->depTails);
+        free(scheduler->depNexts);
+        free(scheduler->depUnits);
+        free(scheduler->incoming);
+        free(scheduler->spareUnits);
+        free(scheduler->ready);
+        free(scheduler->skipped);
+    }
+}
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// jobs per second measured for each number of jobs when none are given
+#define SPAWN_SIZES {1000, 10000, 100000}
+#define SPAWN_LIMIT "64"
+
+// number of cat stages in each pipe chain and the bytes sent through it
+#define PIPE_STAGES {1, 4, 16}
+#define PIPE_BYTES "268435456"
+
+// jobs which are killed at each timeout in ms
+#define TIMEOUT_JOBS 20
+#define TIMEOUTS {50, 200, 1000}
+
+// jobs which sleep for IDLE_SECONDS while the supervisor waits for them
+#define IDLE_JOBS 200
+#define IDLE_SECONDS "3"
+
+// result of one run of jobrunner
+// "wall" is the time in ms it ran for, "cpu" the user and system time in ms
+// used by it and every job it reaped
+typedef struct Run {
+    long long wall;
+    long long cpu;
+} Run;
+
+// function declarations
+void bench_spawn(char*, char*, int);
+void bench_pipes(char*, char*, int);
+void bench_timeouts(char*, char*, int);
+void bench_idle(char*, char*);
+void print_error(char*, int, char*);
+Run run_jobrunner(char*, char**, char*);
+long long current_ms(void);
+
+// the main function
+// runs jobrunner on generated jobfiles and prints the results as one JSON
+// object on stdout
+// takes the jobrunner to measure and optionally the numbers of jobs to use
+// for the spawn rate
+int main(int argc, char** argv) {
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: jrbench jobrunner [jobs ...]\n");
+        return 1;
+    }
+
+    char dir[] = "/tmp/jrbenchXXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "jrbench: can not create a directory in /tmp\n");
+        return 2;
+    }
+
+    int defaultSizes[] = SPAWN_SIZES, pipeStages[] = PIPE_STAGES;
+    int timeouts[] = TIMEOUTS;
+    int sizeCount = sizeof(defaultSizes) / sizeof(int);
+
+    printf("{\n  \"spawn\": [");
+    for (int i = 0; i < (argc > 2 ? argc - 2 : sizeCount); i++) {
+        printf(i ? ",\n    " : "\n    ");
+        bench_spawn(argv[1], dir, argc > 2 ? atoi(argv[i + 2]) :
+                defaultSizes[i]);
+    }
+
+    printf("\n  ],\n  \"pipes\": [");
+    for (int i = 0; i < (int)(sizeof(pipeStages) / sizeof(int)); i++) {
+        printf(i ? ",\n    " : "\n    ");
+        bench_pipes(argv[1], dir, pipeStages[i]);
+    }
+
+    printf("\n  ],\n  \"timeouts\": [");
+    for (int i = 0; i < (int)(sizeof(timeouts) / sizeof(int)); i++) {
+        printf(i ? ",\n    " : "\n    ");
+        bench_timeouts(argv[1], dir, timeouts[i]);
+    }
+
+    printf("\n  ],\n  \"idle\": ");
+    bench_idle(argv[1], dir);
+    printf("\n}\n");
+
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    return system(command) == 0 ? 0 : 2;
+}
+
+// measures the jobs launched and reaped per second for "count" jobs which
+// exit at once, run at most SPAWN_LIMIT at a time
+void bench_spawn(char* jobrunner, char* dir, int count) {
+    char path[64], errPath[64];
+    snprintf(path, sizeof(path), "%s/spawn.jobs", dir);
+    snprintf(errPath, sizeof(errPath), "%s/spawn.err", dir);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        print_error("jobs", count, path);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "true,-,-\n");
+    }
+    fclose(file);
+
+    char* args[] = {jobrunner, "-j", SPAWN_LIMIT, path, NULL};
+    Run run = run_jobrunner(jobrunner, args, errPath);
+
+    printf("{\"jobs\": %d, \"wall_ms\": %lld, \"cpu_ms\": %lld, "
+            "\"jobs_per_second\": %.1f}", count, run.wall, run.cpu,
+            run.wall ? count * 1000.0 / run.wall : 0.0);
+}
+
+// measures the bytes per second sent from head through a chain of "stages"
+// cat jobs connected by pipes
+void bench_pipes(char* jobrunner, char* dir, int stages) {
+    char path[64], errPath[64];
+    snprintf(path, sizeof(path), "%s/pipes.jobs", dir);
+    snprintf(errPath, sizeof(errPath), "%s/pipes.err", dir);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        print_error("stages", stages, path);
+        return;
+    }
+    fprintf(file, "head,/dev/zero,@p0,,-c,%s\n", PIPE_BYTES);
+    for (int i = 0; i < stages; i++) {
+        fprintf(file, "cat,@p%d,@p%d\n", i, i + 1);
+    }
+    fprintf(file, "cat,@p%d,/dev/null\n", stages);
+    fclose(file);
+
+    char* args[] = {jobrunner, path, NULL};
+    Run run = run_jobrunner(jobrunner, args, errPath);
+    long long bytes = atoll(PIPE_BYTES);
+
+    printf("{\"stages\": %d, \"bytes\": %lld, \"wall_ms\": %lld, "
+            "\"cpu_ms\": %lld, \"bytes_per_second\": %.0f}", stages, bytes,
+            run.wall, run.cpu, run.wall ? bytes * 1000.0 / run.wall : 0.0);
+}
+
+// measures how long after a timeout of "timeout" ms each of TIMEOUT_JOBS
+// sleeping jobs is reaped, from the wall times printed by -stats
+void bench_timeouts(char* jobrunner, char* dir, int timeout) {
+    char path[64], errPath[64], line[256];
+    snprintf(path, sizeof(path), "%s/timeouts.jobs", dir);
+    snprintf(errPath, sizeof(errPath), "%s/timeouts.err", dir);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        print_error("timeout_ms", timeout, path);
+        return;
+    }
+    for (int i = 0; i < TIMEOUT_JOBS; i++) {
+        fprintf(file, "sleep,-,-,%dms,60\n", timeout);
+    }
+    fclose(file);
+
+    char* args[] = {jobrunner, "-stats", path, NULL};
+    run_jobrunner(jobrunner, args, errPath);
+
+    long long total = 0, worst = 0, wall;
+    int count = 0, number;
+    file = fopen(errPath, "r");
+    if (file == NULL) {
+        print_error("timeout_ms", timeout, errPath);
+        return;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "Job %d used %lldms wall", &number, &wall) == 2) {
+            total += wall - timeout;
+            worst = wall - timeout > worst ? wall - timeout : worst;
+            count++;
+        }
+    }
+    fclose(file);
+
+    printf("{\"timeout_ms\": %d, \"jobs\": %d, \"mean_late_ms\": %.1f, "
+            "\"max_late_ms\": %lld}", timeout, count,
+            count ? (double)total / count : 0.0, worst);
+}
+
+// measures the cpu time used by jobrunner itself while IDLE_JOBS jobs sleep
+// the time used by the jobs is taken from the -stats summary
+void bench_idle(char* jobrunner, char* dir) {
+    char path[64], errPath[64], line[256];
+    snprintf(path, sizeof(path), "%s/idle.jobs", dir);
+    snprintf(errPath, sizeof(errPath), "%s/idle.err", dir);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        print_error("jobs", IDLE_JOBS, path);
+        return;
+    }
+    for (int i = 0; i < IDLE_JOBS; i++) {
+        fprintf(file, "sleep,-,-,,%s\n", IDLE_SECONDS);
+    }
+    fclose(file);
+
+    char* args[] = {jobrunner, "-stats", path, NULL};
+    Run run = run_jobrunner(jobrunner, args, errPath);
+
+    long long jobUser = 0, jobSystem = 0, makespan;
+    int count;
+    file = fopen(errPath, "r");
+    if (file == NULL) {
+        print_error("jobs", IDLE_JOBS, errPath);
+        return;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        sscanf(line, "Ran %d jobs in %lldms, %lldms user %lldms system",
+                &count, &makespan, &jobUser, &jobSystem);
+    }
+    fclose(file);
+
+    long long cpu = run.cpu - jobUser - jobSystem;
+    printf("{\"jobs\": %d, \"wall_ms\": %lld, \"supervisor_cpu_ms\": %lld, "
+            "\"cpu_percent\": %.2f}", IDLE_JOBS, run.wall, cpu,
+            run.wall ? cpu * 100.0 / run.wall : 0.0);
+}
+
+// prints the result of a measurement that could not be made because the 
+// file "path" could not be opened, with the "field" it was measured for
+void print_error(char* field, int value, char* path) {
+    printf("{\"%s\": %d, \"error\": \"can not open %s\"}", field, value, 
+            path);
+}
+
+// runs jobrunner with "args", discarding its stdout and writing its stderr
+// to the file "errPath"
+// returns the wall time and the cpu time used by jobrunner and its jobs
+Run run_jobrunner(char* jobrunner, char** args, char* errPath) {
+    Run run = {0, 0};
+    long long start = current_ms();
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int out = open("/dev/null", O_WRONLY);
+        int err = open(errPath, O_WRONLY | O_CREAT | O_TRUNC, S_IRWXU);
+        dup2(out, 1);
+        dup2(err, 2);
+        execvp(jobrunner, args);
+        _exit(255);
+    }
+
+    struct rusage usage;
+    int status;
+    if (pid == -1 || wait4(pid, &status, 0, &usage) == -1) {
+        return run;
+    }
+
+    run.wall = current_ms() - start;
+    run.cpu = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000LL +
+            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+    return run;
+}
+
+// gets the current CLOCK_MONOTONIC time in milliseconds
+long long current_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}